@@ -5,6 +5,44 @@
 #include <iterator>
 #include <sstream>
 #include <cassert>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <csignal>
+#include <list>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <cctype>
+#include <limits>
+#include <map>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <array>
+#include <numeric>
+#include <type_traits>
+#include <string_view>
+#include <charconv>
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glob.h>
+#include <poll.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 bool is_little_endian()
 {
@@ -24,15 +62,299 @@ enum class dumptype
   dumptype_uint64,
   dumptype_int64,
   dumptype_float,
-  dumptype_double
+  dumptype_double,
+  dumptype_ubits,
+  dumptype_sbits,
+  dumptype_fp16,
+  dumptype_bf16,
+  dumptype_uint24,
+  dumptype_int24,
+  dumptype_ufixed,
+  dumptype_fixed
 };
 
+// Incremented by the SIGINT handler: every job that was started before the
+// last Ctrl-C stops at its next progress report.
+std::atomic<uint32_t> interrupt_count(0);
+
+// Progress and cancellation token shared between a job and the command loop.
+// Long running scans report how many bytes they handled and poll the token
+// between chunks of job_chunk_size bytes.
+struct job_progress
+{
+  std::atomic<uint64_t> done{0};
+  uint64_t total = 0;
+  std::atomic<bool> cancelled{false};
+  uint32_t interrupt_generation = interrupt_count;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+};
+
+const uint32_t job_chunk_size = 1 << 16;
+
+// Number of running jobs and loops that stop on Ctrl-C. Without any, Ctrl-C
+// ends the application as it does without a handler.
+std::atomic<uint32_t> interrupt_listeners(0);
+
+struct interrupt_listener
+{
+  interrupt_listener() { ++interrupt_listeners; }
+  ~interrupt_listener() { --interrupt_listeners; }
+};
+
+void on_interrupt(int)
+{
+  if (interrupt_listeners == 0)
+  {
+    std::signal(SIGINT, SIG_DFL);
+    std::raise(SIGINT);
+    return;
+  }
+  ++interrupt_count;
+  std::signal(SIGINT, on_interrupt);
+}
+
+bool report_progress(job_progress& progress, uint64_t done)
+{
+  progress.done = done;
+  if (progress.interrupt_generation != interrupt_count)
+    progress.cancelled = true;
+  return progress.cancelled;
+}
+
+// Tasks that a worker split off and waits for.
+struct task_group
+{
+  std::atomic<uint64_t> pending{0};
+  std::mutex mutex;
+  std::condition_variable done;
+
+  // Decrements under the lock, so that the waiter can't return and destroy
+  // the group before the notification is complete.
+  void finish_one()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--pending == 0)
+      done.notify_all();
+  }
+};
+
+// Pool of worker threads that each own a deque of tasks. A worker takes the
+// newest task of its own deque and steals the oldest task of another deque
+// when its own deque is empty. Tasks pushed by a worker go to its own deque,
+// so a task that splits its work keeps the parts local unless other workers
+// run out of work. A worker waiting for a task group only runs the tasks of
+// that group, so it never picks up unrelated work such as another file.
+class work_stealing_pool
+{
+public:
+  work_stealing_pool(uint32_t nr_of_threads)
+  {
+    if (nr_of_threads == 0)
+      nr_of_threads = 1;
+    for (uint32_t i = 0; i < nr_of_threads; ++i)
+      _queues.emplace_back(new task_queue());
+    for (uint32_t i = 0; i < nr_of_threads; ++i)
+      _workers.emplace_back([this, i]() { work(i); });
+  }
+
+  ~work_stealing_pool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(_sleep_mutex);
+      _stop = true;
+    }
+    _wake.notify_all();
+    for (auto& worker : _workers)
+      worker.join();
+  }
+
+  uint32_t size() const
+  {
+    return (uint32_t)_workers.size();
+  }
+
+  void push(std::function<void()> task, task_group* group = nullptr)
+  {
+    if (group)
+      ++group->pending;
+    const uint32_t queue = _current_pool == this ? _current_worker : (uint32_t)(_next_queue++ % _queues.size());
+    {
+      std::lock_guard<std::mutex> lock(_queues[queue]->mutex);
+      _queues[queue]->tasks.push_back({ std::move(task), group });
+    }
+    {
+      std::lock_guard<std::mutex> lock(_sleep_mutex);
+      ++_queued;
+    }
+    _wake.notify_one();
+  }
+
+  // Runs the tasks of group that are still in the deque of the calling
+  // worker, then blocks until the stolen ones are done. Only called by the
+  // workers of this pool.
+  void wait(task_group& group)
+  {
+    task_queue& queue = *_queues[_current_worker];
+    while (group.pending != 0)
+    {
+      std::function<void()> task;
+      {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        for (auto it = queue.tasks.rbegin(); it != queue.tasks.rend(); ++it)
+        {
+          if (it->group == &group)
+          {
+            task = std::move(it->run);
+            queue.tasks.erase(std::next(it).base());
+            break;
+          }
+        }
+      }
+      if (!task)
+        break;
+      --_queued;
+      task();
+      group.finish_one();
+    }
+    std::unique_lock<std::mutex> lock(group.mutex);
+    group.done.wait(lock, [&group]() { return group.pending == 0; });
+  }
+
+  // The pool of the calling thread, or nullptr if it is not a worker.
+  static work_stealing_pool* current()
+  {
+    return _current_pool;
+  }
+
+private:
+  struct pool_task
+  {
+    std::function<void()> run;
+    task_group* group;
+  };
+
+  struct task_queue
+  {
+    std::mutex mutex;
+    std::deque<pool_task> tasks;
+  };
+
+  bool run_one(uint32_t self)
+  {
+    pool_task task;
+    for (uint32_t i = 0; i < _queues.size() && !task.run; ++i)
+    {
+      task_queue& queue = *_queues[(self + i) % _queues.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty())
+        continue;
+      if (i == 0)
+      {
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      }
+      else
+      {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+    }
+    if (!task.run)
+      return false;
+    --_queued;
+    task.run();
+    if (task.group)
+      task.group->finish_one();
+    return true;
+  }
+
+  void work(uint32_t self)
+  {
+    _current_pool = this;
+    _current_worker = self;
+    while (true)
+    {
+      if (run_one(self))
+        continue;
+      std::unique_lock<std::mutex> lock(_sleep_mutex);
+      _wake.wait(lock, [this]() { return _stop || _queued > 0; });
+      if (_stop && _queued == 0)
+        return;
+    }
+  }
+
+  std::vector<std::unique_ptr<task_queue>> _queues;
+  std::vector<std::thread> _workers;
+  std::atomic<uint64_t> _queued{0};
+  std::atomic<uint64_t> _next_queue{0};
+  std::mutex _sleep_mutex;
+  std::condition_variable _wake;
+  bool _stop = false;
+  static thread_local work_stealing_pool* _current_pool;
+  static thread_local uint32_t _current_worker;
+};
+
+thread_local work_stealing_pool* work_stealing_pool::_current_pool = nullptr;
+thread_local uint32_t work_stealing_pool::_current_worker = 0;
+
+// Number of parts worth splitting parallel work into: the workers of the
+// pool of the calling thread, or else the number of cores.
+uint32_t parallel_width()
+  {
+  if (work_stealing_pool* pool = work_stealing_pool::current())
+    return pool->size();
+  return std::max(1u, std::thread::hardware_concurrency());
+  }
+
+// Runs fun(part, first, last) for nr_of_parts contiguous parts of [0, size).
+// On a worker of a work stealing pool the parts become tasks of that pool,
+// otherwise every part gets its own thread.
+void parallel_for(uint32_t nr_of_parts, uint64_t size, std::function<void(uint32_t, uint64_t, uint64_t)> fun)
+  {
+  if (nr_of_parts <= 1)
+    {
+    fun(0, 0, size);
+    return;
+    }
+  if (work_stealing_pool* pool = work_stealing_pool::current())
+    {
+    task_group group;
+    for (uint32_t t = 0; t < nr_of_parts; ++t)
+      {
+      const uint64_t first = size * t / nr_of_parts;
+      const uint64_t last = size * (t + 1) / nr_of_parts;
+      pool->push([&fun, t, first, last]() { fun(t, first, last); }, &group);
+      }
+    pool->wait(group);
+    return;
+    }
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < nr_of_parts; ++t)
+    {
+    const uint64_t first = size * t / nr_of_parts;
+    const uint64_t last = size * (t + 1) / nr_of_parts;
+    threads.emplace_back(fun, t, first, last);
+    }
+  for (auto& thread : threads)
+    thread.join();
+  }
+
+class search_index;
+
 struct hex_state {
   bool little_endiann = is_little_endian();
   uint32_t offset = 0;
   uint32_t length = 0xffffffff;
   dumptype dump_type = dumptype::dumptype_uint8;
   uint32_t data_per_line = 16;
+  uint32_t bit_width = 12;
+  bool msb_first = true;
+  uint32_t q_int_bits = 1;
+  uint32_t q_frac_bits = 15;
+  std::shared_ptr<const std::vector<uint32_t>> hits;
+  std::vector<uint8_t> hits_needle;
+  std::vector<uint8_t> find_needle;
+  std::shared_ptr<const search_index> index;
 };
 
 std::string int_to_hex(uint8_t i)
@@ -118,7 +440,7 @@ void treat_buffer(std::vector<uint8_t>& arr, std::vector<char>& buffer)
   }
 }
 
-std::vector<uint8_t> hex_to_byte_array(const std::string& hex)
+std::vector<uint8_t> hex_to_byte_array(const std::string& hex, std::ostream& str)
 {
   std::vector<uint8_t> arr;
   auto it = hex.begin();
@@ -144,7 +466,7 @@ std::vector<uint8_t> hex_to_byte_array(const std::string& hex)
     }
     else if (c != ' ' && c != '\n' && c != '#')
     {
-      std::cout << "Error: invalid character " << c << " at position " << std::distance(hex.begin(), it) << std::endl;
+      str << "Error: invalid character " << c << " at position " << std::distance(hex.begin(), it) << std::endl;
       treat_buffer(arr, buffer);
       buffer.clear();
     }
@@ -190,101 +512,12 @@ void output(std::ostream& str, char value)
 }
 
 
-template <class T>
-class TypeInterpreter
-{
-public:
-
-  typedef T value_type;
-
-  TypeInterpreter(bool little_endiann = true) : _little_endiann(little_endiann) {}
-  
-  void operator()(const std::vector<uint8_t>& characters, std::ostream& str)
-  {
-    assert(sizeof(T) <= 8);
-    auto it = characters.begin();
-    const auto it_end = characters.end();
-    while (it != it_end)
-    {
-      std::vector<uint64_t> values;
-      for (int i = 0; i < sizeof(T); ++i)
-      {
-        if (it != it_end)
-          values.push_back(*it++);
-      }
-      uint64_t number = 0;
-      if (_little_endiann)
-      {
-        for (auto rit = values.rbegin(); rit != values.rend(); ++rit)
-        {
-          number = (number << 8) | *rit;
-        }
-      }
-      else
-      {
-        for (auto rit = values.begin(); rit != values.end(); ++rit)
-        {
-          number = (number << 8) | *rit;
-        }
-      }
-      const T val = *reinterpret_cast<T*>(&number);
-      output<T>(str, val);
-    }
-  }
-  
-  bool _little_endiann;
-};
-
-template <class T>
-class TypeInterpreterToVector
-{
-public:
-
-  typedef T value_type;
-
-  TypeInterpreterToVector(bool little_endiann = true) : _little_endiann(little_endiann) {}
-  
-  void operator()(const std::vector<uint8_t>& characters, std::vector<T>& data)
-  {
-    assert(sizeof(T) <= 8);
-    auto it = characters.begin();
-    const auto it_end = characters.end();
-    while (it != it_end)
-    {
-      std::vector<uint64_t> values;
-      for (int i = 0; i < sizeof(T); ++i)
-      {
-        if (it != it_end)
-          values.push_back(*it++);
-      }
-      uint64_t number = 0;
-      if (_little_endiann)
-      {
-        for (auto rit = values.rbegin(); rit != values.rend(); ++rit)
-        {
-          number = (number << 8) | *rit;
-        }
-      }
-      else
-      {
-        for (auto rit = values.begin(); rit != values.end(); ++rit)
-        {
-          number = (number << 8) | *rit;
-        }
-      }
-      const T val = *reinterpret_cast<T*>(&number);
-      data.push_back(val);
-    }
-  }
-  
-  bool _little_endiann;
-};
-
 template <class TIter, class TInterpreter>
-void print_byte_array(uint32_t address, TIter first, TIter last, TInterpreter interpreter, uint32_t elements_per_row, std::ostream& str)
+void print_byte_array(uint32_t address, TIter first, TIter last, TInterpreter interpreter, uint32_t elements_per_row, std::ostream& str, job_progress& progress)
 {
   size_t size = std::distance(first, last);
-  std::vector<uint8_t> characters;
+  static thread_local std::vector<uint8_t> characters;
+  characters.clear();
   str << int_to_hex((uint32_t)address) << ": ";
   for (uint32_t i = 0; i < size; ++i, ++first)
   {
@@ -296,6 +529,11 @@ void print_byte_array(uint32_t address, TIter first, TIter last, TInterpreter in
       interpreter(characters, str);
       characters.clear();
       str << std::endl;
+      if (report_progress(progress, i + 1))
+      {
+        str << "Dump cancelled.\n";
+        return;
+      }
       if (i != size - 1)
       {
         str << int_to_hex((uint32_t)(i+1+address)) << ": ";
@@ -324,271 +562,216 @@ std::vector<uint8_t> read_input(const std::string& input)
   else
   {
     std::cout << "Interpreting command line argument as a hex text.\n";
-    return hex_to_byte_array(input);
-  }
-}
-
-uint32_t size_of(dumptype dt)
-{
-  switch (dt)
-  {
-    case dumptype::dumptype_uint8:
-      return sizeof(uint8_t);
-    case dumptype::dumptype_int8:
-      return sizeof(int8_t);
-    case dumptype::dumptype_uint16:
-      return sizeof(uint16_t);
-    case dumptype::dumptype_int16:
-      return sizeof(int16_t);
-    case dumptype::dumptype_uint32:
-      return sizeof(uint32_t);
-    case dumptype::dumptype_int32:
-      return sizeof(int32_t);
-    case dumptype::dumptype_uint64:
-      return sizeof(uint64_t);
-    case dumptype::dumptype_int64:
-      return sizeof(int64_t);
-    case dumptype::dumptype_float:
-      return sizeof(float);
-    case dumptype::dumptype_double:
-      return sizeof(double);
-  }
-}
-
-std::string dump_type_to_str(dumptype dt)
-{
-  switch (dt)
-  {
-    case dumptype::dumptype_uint8:
-      return std::string("uint8_t");
-    case dumptype::dumptype_int8:
-      return std::string("int8_t");
-    case dumptype::dumptype_uint16:
-      return std::string("uint16_t");
-    case dumptype::dumptype_int16:
-      return std::string("int16_t");
-    case dumptype::dumptype_uint32:
-      return std::string("uint32_t");
-    case dumptype::dumptype_int32:
-      return std::string("int32_t");
-    case dumptype::dumptype_uint64:
-      return std::string("uint64_t");
-    case dumptype::dumptype_int64:
-      return std::string("int64_t");
-    case dumptype::dumptype_float:
-      return std::string("float");
-    case dumptype::dumptype_double:
-      return std::string("double");
-  }
-}
-
-void print_help()
-{
-  std::cout << "Available commands:\n";
-  std::cout << "  d, dump         : dump the interpreted hex data\n";
-  std::cout << "  offset <nr>     : change the dump offset to nr\n";
-  std::cout << "  length <nr>     : change the dump length to nr\n";
-  std::cout << "  row <nr>        : change the row length to nr\n";
-  std::cout << "  + <nr>          : add nr to the offset\n";
-  std::cout << "  - <nr>          : subtract nr from the offset\n";
-  std::cout << "  type b|B|h|H|i|I|q|Q|f|d\n";
-  std::cout << "                  : change the interpreted type\n";
-  std::cout << "  find <str>      : find next occurrence of str\n";
-  std::cout << "  find# <hex str> : find next occurrence of hex str\n";
-  std::cout << "  clamp min max length\n";
-  std::cout << "                  : find streak of minimum size\n";
-  std::cout << "                    length where each element is\n";
-  std::cout << "                    in the interval [min, max]\n";
-  std::cout << "  little          : interpret as little endianness\n";
-  std::cout << "  big             : interpret as big endianness\n";
-  std::cout << "  endianness      : shows this PCs endianness\n";
-  std::cout << "  state           : print the current dump state\n";
-  std::cout << "  >> <file>       : stream output to a file\n";
-  std::cout << "  q, quit, exit   : quit the application\n";
-}
-
-int count_connectors(std::string temp)
-{
-  auto it = temp.find_first_of('"');
-  int found = 0;
-  while (it != std::string::npos)
-  {
-    ++found;
-    temp.erase(temp.begin(), temp.begin() + it + 1);
-    it = temp.find_first_of('"');
-  }
-  return found;
-}
-
-std::vector<std::string> get_arguments(const std::string& command)
-{
-  std::vector<std::string> output;
-  std::stringstream sstr;
-  sstr << command;
-  bool connector_present = false;
-  while (!sstr.eof())
-  {
-    std::string temp;
-    sstr >> temp;
-    int connectors_found = count_connectors(temp);
-    bool connector_found = false;
-    if (connectors_found % 2 == 1)
-      connector_found = true;
-    if (connector_present)
-    {
-      output.back() += " ";
-      output.back() += temp;
-      if (connector_found)
-        connector_present = false;
-    }
-    else
+    return hex_to_byte_array(input, std::cout);
+  }
+}
+
+bool read_file(const std::string& filename, std::vector<uint8_t>& byte_arr)
+{
+  std::ifstream f(filename, std::ifstream::in | std::ifstream::binary);
+  if (!f.is_open())
+    return false;
+  byte_arr.assign(std::istreambuf_iterator<char>(f), {});
+  return true;
+}
+
+bool is_file(const std::string& input)
+{
+  std::ifstream f(input, std::ifstream::in | std::ifstream::binary);
+  return f.is_open();
+}
+
+const uint32_t max_bit_width = 57;
+
+uint64_t byte_swap(uint64_t value)
+{
+#ifdef _MSC_VER
+  return _byteswap_uint64(value);
+#else
+  return __builtin_bswap64(value);
+#endif
+}
+
+// Loads 8 bytes as a big endian (msb first) or little endian (lsb first) word.
+inline uint64_t load_bit_window(const uint8_t* p, bool msb_first)
+{
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+  if (msb_first == is_little_endian())
+    word = byte_swap(word);
+  return word;
+}
+
+// Decodes count packed values of width bits, starting with value first_value
+// of the bit stream at data. Every value is extracted from the unaligned 8 byte
+// window that contains it (a value of up to 57 bits starts at most 7 bits into
+// its first byte, so it always fits), without branches on the bit position.
+// Only the values whose window would pass the end of the data go through a
+// zero padded copy. This is the scalar path; packed_type::decode runs
+// unpack_bits_avx2 first where the cpu has it.
+template <bool msb_first, bool is_signed>
+void unpack_bits(const uint8_t* data, uint64_t size, uint32_t width, uint64_t first_value, uint64_t count, uint64_t* out)
+{
+  const uint64_t mask = (~0ull) >> (64 - width);
+  const uint32_t sign_shift = 64 - width;
+  const uint64_t safe_values = size >= 8 ? ((size - 7) * 8 + width - 1) / width : 0;
+  const uint64_t last_value = first_value + count;
+  const uint64_t safe_last = last_value < safe_values ? last_value : (first_value > safe_values ? first_value : safe_values);
+  uint64_t i = first_value;
+  for (; i < safe_last; ++i)
+  {
+    const uint64_t bit = i * width;
+    const uint64_t word = load_bit_window(data + (bit >> 3), msb_first);
+    uint64_t value = msb_first ? (word << (bit & 7)) >> sign_shift : (word >> (bit & 7)) & mask;
+    if (is_signed)
+      value = (uint64_t)((int64_t)(value << sign_shift) >> sign_shift);
+    *out++ = value;
+  }
+  for (; i < last_value; ++i)
+  {
+    const uint64_t bit = i * width;
+    uint8_t window[8] = { 0 };
+    memcpy(window, data + (bit >> 3), (size_t)(size - (bit >> 3) < 8 ? size - (bit >> 3) : 8));
+    const uint64_t word = load_bit_window(window, msb_first);
+    uint64_t value = msb_first ? (word << (bit & 7)) >> sign_shift : (word >> (bit & 7)) & mask;
+    if (is_signed)
+      value = (uint64_t)((int64_t)(value << sign_shift) >> sign_shift);
+    *out++ = value;
+  }
+}
+
+bool is_bit_type(dumptype dt)
+{
+  return dt == dumptype::dumptype_ubits || dt == dumptype::dumptype_sbits;
+}
+
+void print_help(std::ostream& str)
+{
+  str << "Available commands:\n";
+  str << "  d, dump         : dump the interpreted hex data\n";
+  str << "  offset <nr>     : change the dump offset to nr\n";
+  str << "  length <nr>     : change the dump length to nr\n";
+  str << "  row <nr>        : change the row length to nr\n";
+  str << "  + <nr>          : add nr to the offset\n";
+  str << "  - <nr>          : subtract nr from the offset\n";
+  str << "  type b|B|h|H|i|I|q|Q|f|d|e|bf16|int24|uint24|\n";
+  str << "       u<N>|s<N>|q<m>.<n>|uq<m>.<n>\n";
+  str << "                  : change the interpreted type, e is\n";
+  str << "                    fp16, u<N> and s<N> are packed\n";
+  str << "                    values of N bits, q<m>.<n> and\n";
+  str << "                    uq<m>.<n> are fixed point numbers\n";
+  str << "  bits <nr>       : change the width of packed values\n";
+  str << "  bitorder msb|lsb: read packed values msb or lsb first\n";
+  str << "  export <file>   : write the values in the dump range\n";
+  str << "                    to file, one per line\n";
+  str << "  find <str>      : find next occurrence of str\n";
+  str << "  find# <hex str> : find next occurrence of hex str\n";
+  str << "  findall <str>   : find all occurrences of str\n";
+  str << "  findall# <hex str>\n";
+  str << "                  : find all occurrences of hex str\n";
+  str << "  findval <x> [tolerance] [both]\n";
+  str << "                  : find all values x of the current\n";
+  str << "                    type at any alignment, tolerance\n";
+  str << "                    is absolute or <n>ulp, both also\n";
+  str << "                    tries the other byte order\n";
+  str << "  hits            : list the hits of the last search\n";
+  str << "  hit <nr>        : change the offset to hit nr\n";
+  str << "  summary         : count, min, max and mean of the\n";
+  str << "                    values in the dump range\n";
+  str << "  hash            : FNV-1a hash of the dump range\n";
+  str << "  clamp min max length\n";
+  str << "                  : find streak of minimum size\n";
+  str << "                    length where each element is\n";
+  str << "                    in the interval [min, max]\n";
+  str << "  little          : interpret as little endianness\n";
+  str << "  big             : interpret as big endianness\n";
+  str << "  endianness      : shows this PCs endianness\n";
+  str << "  state           : print the current dump state\n";
+  str << "  index build [step]\n";
+  str << "                  : build a search index sampling every\n";
+  str << "                    step bytes and store it next to the\n";
+  str << "                    input file, find and findall use it\n";
+  str << "  index           : show the state of the search index\n";
+  str << "  follow          : watch the input file and dump the\n";
+  str << "                    rows that are appended to it, the\n";
+  str << "                    last find needle is searched for\n";
+  str << "                    in the new data, Ctrl-C stops\n";
+  str << "  <command> &     : run a find, clamp, summary, hash or\n";
+  str << "                    dump as a background job\n";
+  str << "  jobs            : list the running background jobs\n";
+  str << "  cancel [<id>]   : cancel job id, or all jobs\n";
+  str << "                    Ctrl-C cancels all running jobs\n";
+  str << "  >> <file>       : stream output to a file\n";
+  str << "  q, quit, exit   : quit the application\n";
+}
+
+// Splits command into the tokens separated by white space, reusing the
+// storage of tokens. A token that opens a quote extends up to the closing
+// quote, so quoted strings can contain spaces. The tokens point into command.
+void tokenize(std::string_view command, std::vector<std::string_view>& tokens)
+{
+  tokens.clear();
+  size_t i = 0;
+  while (true)
+  {
+    while (i < command.size() && std::isspace((unsigned char)command[i]))
+      ++i;
+    if (i == command.size())
+      break;
+    const size_t first = i;
+    bool quoted = false;
+    while (i < command.size() && (quoted || !std::isspace((unsigned char)command[i])))
     {
-      output.push_back(temp);
-      if (connector_found)
-        connector_present = true;
+      if (command[i] == '"')
+        quoted = !quoted;
+      ++i;
     }
+    tokens.push_back(command.substr(first, i - first));
   }
-  return output;
 }
 
-double interpret_double(const std::string& s) {
-    std::stringstream sstr;
-    sstr << s;
-    double x;
-    sstr >> x;
-    return x;
+// The number parsers return 0 for text that does not start with a number.
+double interpret_double(std::string_view s) {
+  if (!s.empty() && s[0] == '+')
+    s.remove_prefix(1);
+  double x = 0.0;
+#ifdef __cpp_lib_to_chars
+  std::from_chars(s.data(), s.data() + s.size(), x);
+#else
+  char buffer[64];
+  const size_t size = std::min(s.size(), sizeof(buffer) - 1);
+  memcpy(buffer, s.data(), size);
+  buffer[size] = 0;
+  x = std::strtod(buffer, nullptr);
+#endif
+  return x;
 }
 
 template <class T>
-T interpret_number(const std::string& s) {
-    std::stringstream sstr;
-    sstr << s;
-    T x;
-    sstr >> x;
-    return x;
+T interpret_number(std::string_view s) {
+  if (!s.empty() && s[0] == '+')
+    s.remove_prefix(1);
+  T x = 0;
+  std::from_chars(s.data(), s.data() + s.size(), x);
+  return x;
 }
 
-uint32_t interpret_number(const std::string& s)
+uint32_t interpret_number(std::string_view s)
   {
   if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) // hex number
     {
-    std::stringstream sstr;
-    sstr << std::hex << s;
-    uint32_t x;
-    sstr >> x;
+    uint32_t x = 0;
+    std::from_chars(s.data() + 2, s.data() + s.size(), x, 16);
     return x;
     }
-  else
-    {
-    std::stringstream sstr;
-    sstr << s;
-    uint32_t x;
-    sstr >> x;
-    return x;
-    }
-  }
-  
-dumptype interpret_dumptype(const std::string& s)
-  {
-  if (s == "int8" || s == "int8_t" || s == "b")
-    return dumptype::dumptype_int8;
-  if (s == "uint8" || s == "uint8_t" || s == "B")
-    return dumptype::dumptype_uint8;
-  if (s == "int16" || s == "int16_t" || s == "h")
-    return dumptype::dumptype_int16;
-  if (s == "uint16" || s == "uint16_t" || s == "H")
-    return dumptype::dumptype_uint16;
-  if (s == "int32" || s == "int32_t" || s == "i")
-    return dumptype::dumptype_int32;
-  if (s == "uint32" || s == "uint32_t" || s == "I")
-    return dumptype::dumptype_uint32;
-  if (s == "int64" || s == "int64_t" || s == "q")
-    return dumptype::dumptype_int64;
-  if (s == "uint64" || s == "uint64_t" || s == "Q")
-    return dumptype::dumptype_uint64;
-  if (s == "float" || s == "f")
-    return dumptype::dumptype_float;
-  if (s == "double" || s == "d")
-    return dumptype::dumptype_double;
-  return dumptype::dumptype_uint8;
-  }
-
-template <class TInterpreter>
-void find_clamp(uint32_t& offset, const std::vector<uint8_t>& byte_arr, const std::string& minimum_str, const std::string& maximum_str, uint32_t length, TInterpreter interpreter) {
-  typename TInterpreter::value_type minimum = interpret_number<typename TInterpreter::value_type>(minimum_str);
-  typename TInterpreter::value_type maximum = interpret_number<typename TInterpreter::value_type>(maximum_str);
-  std::cout << "Looking for clamp of length " << length << " where data is in the interval [" << minimum << ", " << maximum << "]\n";
-  std::vector<uint8_t> characters;
-  std::vector<typename TInterpreter::value_type> values;
-  for (uint32_t i = offset+1; i < (uint32_t)byte_arr.size(); ++i)
-    {
-    values.clear();
-    size_t type_size = sizeof(typename TInterpreter::value_type);
-    size_t current_offset = i;
-    bool values_vector_is_correctly_clamped = true;
-    while (values_vector_is_correctly_clamped) {
-      characters.clear();
-      if (current_offset+type_size < byte_arr.size()) {
-        for (size_t j = 0; j < type_size; ++j) {
-          characters.push_back(byte_arr[current_offset+j]);
-          }
-        interpreter(characters, values);
-        values_vector_is_correctly_clamped = values.back() >= minimum && values.back() <= maximum;
-        if (!values_vector_is_correctly_clamped)
-          values.pop_back();
-        current_offset += type_size;
-      } else
-        values_vector_is_correctly_clamped = false;
-    }
-    if (values.size() >= length) {
-      std::cout << "A valid offset has been found\n";
-      offset = i;
-      return;
-    }
-  }
-}
-  
-void find_clamp(uint32_t& offset, const std::vector<uint8_t>& byte_arr, const std::string& minimum_str, const std::string& maximum_str, const std::string& length_str, hex_state& state) {
-  uint32_t length = interpret_number(length_str);
-  switch (state.dump_type) {
-    case dumptype::dumptype_uint8:
-      find_clamp(state.offset, byte_arr, minimum_str, maximum_str, length, TypeInterpreterToVector<uint8_t>(state.little_endiann));
-      break;
-    case dumptype::dumptype_int8:
-      find_clamp(state.offset, byte_arr, minimum_str, maximum_str, length, TypeInterpreterToVector<int8_t>(state.little_endiann));
-      break;
-    case dumptype::dumptype_uint16:
-      find_clamp(state.offset, byte_arr, minimum_str, maximum_str, length, TypeInterpreterToVector<uint16_t>(state.little_endiann));
-      break;
-    case dumptype::dumptype_int16:
-      find_clamp(state.offset, byte_arr, minimum_str, maximum_str, length, TypeInterpreterToVector<int16_t>(state.little_endiann));
-      break;
-    case dumptype::dumptype_uint32:
-      find_clamp(state.offset, byte_arr, minimum_str, maximum_str, length, TypeInterpreterToVector<uint32_t>(state.little_endiann));
-      break;
-    case dumptype::dumptype_int32:
-      find_clamp(state.offset, byte_arr, minimum_str, maximum_str, length, TypeInterpreterToVector<int32_t>(state.little_endiann));
-      break;
-    case dumptype::dumptype_uint64:
-      find_clamp(state.offset, byte_arr, minimum_str, maximum_str, length, TypeInterpreterToVector<uint64_t>(state.little_endiann));
-      break;
-    case dumptype::dumptype_int64:
-      find_clamp(state.offset, byte_arr, minimum_str, maximum_str, length, TypeInterpreterToVector<int64_t>(state.little_endiann));
-      break;
-    case dumptype::dumptype_float:
-      find_clamp(state.offset, byte_arr, minimum_str, maximum_str, length, TypeInterpreterToVector<float>(state.little_endiann));
-      break;
-    case dumptype::dumptype_double:
-      find_clamp(state.offset, byte_arr, minimum_str, maximum_str, length, TypeInterpreterToVector<double>(state.little_endiann));
-      break;
+  return interpret_number<uint32_t>(s);
   }
-}
-  
-void find_next_occurence(uint32_t& offset, const std::vector<uint8_t>& byte_arr, const std::string& s, bool string_is_hex)
+
+std::vector<uint8_t> make_find_array(const std::string& s, bool string_is_hex, std::ostream& str)
   {
   std::vector<uint8_t> find_arr;
   if (string_is_hex)
-    find_arr = hex_to_byte_array(s);
+    find_arr = hex_to_byte_array(s, str);
   else
     {
     find_arr.reserve(s.size());
@@ -596,22 +779,30 @@ void find_next_occurence(uint32_t& offset, const std::vector<uint8_t>& byte_arr,
       find_arr.push_back((uint8_t)ch);
     }
   if (find_arr.empty())
-    {
-    std::cout << "Nothing to find.\n";
-    return;
-    }
+    str << "Nothing to find.\n";
+  return find_arr;
+  }
+
+void find_next_occurence(uint32_t& offset, const std::vector<uint8_t>& byte_arr, const std::vector<uint8_t>& find_arr, job_progress& progress, std::ostream& str)
+  {
+  uint64_t scanned = 0;
   uint32_t current_matched_index = 0;
   for (uint32_t i = offset+1; i < (uint32_t)byte_arr.size(); ++i)
     {
+    if (++scanned % job_chunk_size == 0 && report_progress(progress, scanned))
+      {
+      str << "Search cancelled.\n";
+      return;
+      }
     if (byte_arr[i] == find_arr[current_matched_index])
       {
       ++current_matched_index;
       if (current_matched_index >= find_arr.size())
         {
         uint32_t pos = i + 1 - current_matched_index;
-        std::cout << "Found next occurence at position 0x" << int_to_hex(pos) << ".\n";
+        str << "Found next occurence at position 0x" << int_to_hex(pos) << ".\n";
         offset = pos;
-        std::cout << "Setting offset to " << offset << "(0x" << int_to_hex(offset) << ").\n";
+        str << "Setting offset to " << offset << "(0x" << int_to_hex(offset) << ").\n";
         return;
         }
       }
@@ -625,15 +816,20 @@ void find_next_occurence(uint32_t& offset, const std::vector<uint8_t>& byte_arr,
     end_of_find = (uint32_t)byte_arr.size();
   for (uint32_t i = 0; i < end_of_find; ++i)
     {
+    if (++scanned % job_chunk_size == 0 && report_progress(progress, scanned))
+      {
+      str << "Search cancelled.\n";
+      return;
+      }
     if (byte_arr[i] == find_arr[current_matched_index])
       {
       ++current_matched_index;
       if (current_matched_index >= find_arr.size())
         {
         uint32_t pos = i + 1 - current_matched_index;
-        std::cout << "Found next occurence at position 0x" << int_to_hex(pos) << ".\n";
+        str << "Found next occurence at position 0x" << int_to_hex(pos) << ".\n";
         offset = pos;
-        std::cout << "Setting offset to " << offset << "(0x" << int_to_hex(offset) << ").\n";
+        str << "Setting offset to " << offset << "(0x" << int_to_hex(offset) << ").\n";
         return;
         }
       }
@@ -642,217 +838,2785 @@ void find_next_occurence(uint32_t& offset, const std::vector<uint8_t>& byte_arr,
       current_matched_index = 0;
       }
     }
-  std::cout << "Found no occurrence.\n";
+  str << "Found no occurrence.\n";
   }
 
 
-void hex_interpret(const std::vector<uint8_t>& byte_arr)
-{
-  std::string command;
-  hex_state state;
-  while (command != "exit" && command != "quit" && command != "q")
+// Returns the positions of all (possibly overlapping) occurrences of find_arr
+// that start at or after first.
+// The data is searched in chunks of job_chunk_size bytes that overlap by the
+// needle length, so the job can be cancelled in between.
+std::vector<uint32_t> find_all_occurrences(const std::vector<uint8_t>& byte_arr, const std::vector<uint8_t>& find_arr, job_progress& progress, uint64_t first = 0)
   {
-    std::cout << "> ";
-    std::getline(std::cin, command);
-    auto arguments = get_arguments(command);
-    size_t argc = arguments.size();
-    std::string outputfile;
-    bool dump = false;
-    for (int i = 0; i < argc; ++i)
-    {
-      if (arguments[i] == "help" || arguments[i] == "?" || arguments[i] == "-?")
-        print_help();
-      else if (arguments[i] == "little")
-        state.little_endiann = true;
-      else if (arguments[i] == "big")
-        state.little_endiann = false;
-      else if (arguments[i] == "offset" && (i < (argc - 1)))
-      {
-        ++i;
-        state.offset = interpret_number(arguments[i]);
-        std::cout << "Setting offset to " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
-      }
-      else if (arguments[i] == "offset")
-        {
-        std::cout << "The offset equals " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
-        }
-      else if (arguments[i] == "length" && (i < (argc - 1)))
-      {
-        ++i;
-        state.length = interpret_number(arguments[i]);
-        std::cout << "Setting length to " << state.length << "(0x" << int_to_hex(state.length) << ").\n";
-      }
-      else if (arguments[i] == "length")
-        {
-        std::cout << "The length equals " << state.length << "(0x" << int_to_hex(state.length) << ").\n";
-        }
-      else if (arguments[i] == "type" && (i < (argc - 1)))
-      {
-        ++i;
-        state.dump_type = interpret_dumptype(arguments[i]);
-        std::cout << "Interpreting the bytes as " << dump_type_to_str(state.dump_type) << ".\n";
-      }
-      else if (arguments[i] == "type")
-        {
-        std::cout << "The type equals " << dump_type_to_str(state.dump_type) << ".\n";
-        }
-      else if (arguments[i] == "row" && (i < (argc - 1)))
+  std::vector<uint32_t> hits;
+  if (find_arr.empty() || first + find_arr.size() > byte_arr.size())
+    return hits;
+  std::boyer_moore_horspool_searcher<std::vector<uint8_t>::const_iterator> searcher(find_arr.begin(), find_arr.end());
+  const uint64_t nr_of_chunks = (byte_arr.size() - find_arr.size() - first) / job_chunk_size + 1;
+  const uint32_t nr_of_parts = (uint32_t)std::min<uint64_t>(parallel_width(), (nr_of_chunks + 15) / 16);
+  std::vector<std::vector<uint32_t>> part_hits(nr_of_parts);
+  std::atomic<uint64_t> done(0);
+  parallel_for(nr_of_parts, nr_of_chunks, [&](uint32_t t, uint64_t first_chunk, uint64_t last_chunk) {
+    for (uint64_t c = first_chunk; c < last_chunk; ++c)
       {
-        ++i;
-        state.data_per_line = interpret_number(arguments[i]);
-        std::cout << state.data_per_line << " interpreted values will be printed per row.\n";
-      }
-      else if (arguments[i] == "row")
+      if (report_progress(progress, done += job_chunk_size))
+        return;
+      const size_t chunk = first + c * job_chunk_size;
+      const size_t chunk_end = std::min(chunk + job_chunk_size + find_arr.size() - 1, byte_arr.size());
+      auto it = byte_arr.begin() + chunk;
+      const auto it_end = byte_arr.begin() + chunk_end;
+      while (true)
         {
-        std::cout << state.data_per_line << " interpreted values will be printed per row.\n";
+        it = std::search(it, it_end, searcher);
+        if (it == it_end)
+          break;
+        part_hits[t].push_back((uint32_t)std::distance(byte_arr.begin(), it));
+        ++it;
         }
-      else if (arguments[i] == "find" && (i < (argc - 1)))
-      {
-        ++i;
-        find_next_occurence(state.offset, byte_arr, arguments[i], false);
       }
-      else if (arguments[i] == "find#" && (i < (argc - 1)))
+    });
+  for (const auto& part : part_hits)
+    hits.insert(hits.end(), part.begin(), part.end());
+  return hits;
+  }
+
+void print_hits(const std::vector<uint32_t>& hits, std::ostream& str)
+  {
+  const size_t max_printed = 16;
+  str << "Found " << hits.size() << " occurrence" << (hits.size() == 1 ? "" : "s") << ".\n";
+  for (size_t i = 0; i < hits.size() && i < max_printed; ++i)
+    str << "  hit " << i << ": 0x" << int_to_hex(hits[i]) << "\n";
+  if (hits.size() > max_printed)
+    str << "  ...\n";
+  }
+
+// FNV-1a 64 bit hash of the bytes in [first, last).
+uint64_t hash_range(const uint8_t* first, const uint8_t* last, job_progress& progress)
+  {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  const uint8_t* chunk = first;
+  while (chunk != last)
+    {
+    const uint8_t* chunk_end = (size_t)(last - chunk) > job_chunk_size ? chunk + job_chunk_size : last;
+    for (const uint8_t* p = chunk; p != chunk_end; ++p)
       {
-        ++i;
-        find_next_occurence(state.offset, byte_arr, arguments[i], true);
+      hash ^= *p;
+      hash *= 0x100000001b3ull;
       }
-      else if (arguments[i] == "clamp" && (i < (argc - 3))) {
-        find_clamp(state.offset, byte_arr, arguments[i+1], arguments[i+2], arguments[i+3], state);
-        i += 3;
-      }
-      else if (arguments[i] == "+" && (i < (argc - 1)))
-      {
-        ++i;
-        state.offset += interpret_number(arguments[i]);
-        std::cout << "Setting offset to " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
-      }
-      else if (arguments[i].find("+") == 0)
+    chunk = chunk_end;
+    if (report_progress(progress, chunk - first))
+      break;
+    }
+  return hash;
+  }
+
+std::string hash_to_hex(uint64_t hash)
+  {
+  return int_to_hex((uint32_t)(hash >> 32)) + int_to_hex((uint32_t)hash);
+  }
+
+template <class T>
+struct value_summary
+  {
+  uint64_t count = 0;
+  T minimum = T();
+  T maximum = T();
+  double sum = 0.0;
+  };
+
+// Writes a number so that it is valid json: 8 bit values are printed as
+// numbers instead of characters, and non finite floats become null.
+template <class T>
+void output_json(std::ostream& str, T value)
+  {
+  if (!std::isfinite((double)value))
+    str << "null";
+  else
+    str << +value;
+  }
+
+template <class T>
+void print_summary(const value_summary<T>& s, std::ostream& str, bool json)
+  {
+  if (json)
+    {
+    str << "\"count\":" << s.count;
+    if (s.count)
       {
-        arguments[i].erase(arguments[i].begin(), arguments[i].begin() + 1);
-        state.offset += interpret_number(arguments[i]);
-        std::cout << "Setting offset to " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
+      str << ",\"min\":";
+      output_json(str, s.minimum);
+      str << ",\"max\":";
+      output_json(str, s.maximum);
+      str << ",\"mean\":";
+      output_json(str, s.sum / s.count);
       }
-      else if (arguments[i] == "-" && (i < (argc - 1)))
+    }
+  else
+    {
+    str << "Summary of " << s.count << " values.\n";
+    if (s.count)
       {
-        ++i;
-        uint32_t subtract = interpret_number(arguments[i]);
-        state.offset = subtract > state.offset ? 0 : state.offset-subtract;
-        std::cout << "Setting offset to " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
+      str << "  min  : " << +s.minimum << "\n";
+      str << "  max  : " << +s.maximum << "\n";
+      str << "  mean : " << s.sum / s.count << "\n";
       }
-      else if (arguments[i].find("-") == 0)
+    }
+  }
+
+template <class T, bool little_endiann>
+inline T load_scalar(const uint8_t* p)
+  {
+  uint8_t bytes[sizeof(T)];
+  memcpy(bytes, p, sizeof(T));
+  if (little_endiann != is_little_endian())
+    std::reverse(bytes, bytes + sizeof(T));
+  T value;
+  memcpy(&value, bytes, sizeof(T));
+  return value;
+  }
+
+float half_to_float(uint16_t h)
+  {
+  const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  uint32_t bits;
+  if (exponent == 0x1f)
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  else if (exponent != 0)
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  else if (mantissa == 0)
+    bits = sign;
+  else
+    {
+    // subnormal: normalize the mantissa
+    exponent = 113;
+    while ((mantissa & 0x400) == 0)
       {
-        arguments[i].erase(arguments[i].begin(), arguments[i].begin() + 1);
-        uint32_t subtract = interpret_number(arguments[i]);
-        state.offset = subtract > state.offset ? 0 : state.offset-subtract;
-        std::cout << "Setting offset to " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
+      mantissa <<= 1;
+      --exponent;
       }
-      else if (arguments[i] == ">>" && (i < (argc - 1)))
+    bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+  }
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define HEX_INTERPRET_F16C
+
+bool cpu_has_f16c()
+  {
+  static const bool has_f16c = __builtin_cpu_supports("f16c");
+  return has_f16c;
+  }
+
+// Converts eight halves at a time with vcvtph2ps, swapping the bytes of each
+// half first when the data is big endian.
+template <bool swap_bytes>
+__attribute__((target("f16c"))) void halves_to_floats_f16c(const uint8_t* p, uint64_t count, float* out)
+  {
+  uint64_t i = 0;
+  for (; i + 8 <= count; i += 8)
+    {
+    __m128i halves = _mm_loadu_si128((const __m128i*)(p + 2 * i));
+    if (swap_bytes)
+      halves = _mm_or_si128(_mm_slli_epi16(halves, 8), _mm_srli_epi16(halves, 8));
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(halves));
+    }
+  for (; i < count; ++i)
+    {
+    uint16_t h;
+    memcpy(&h, p + 2 * i, sizeof(h));
+    if (swap_bytes)
+      h = (uint16_t)((h << 8) | (h >> 8));
+    out[i] = half_to_float(h);
+    }
+  }
+
+#define HEX_INTERPRET_AVX2
+
+bool cpu_has_avx2()
+  {
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+  }
+
+// Decodes four packed values at a time: vpgatherqq loads the 8 byte window of
+// each value, vpshufb turns it msb first if needed, and the variable shifts
+// vpsllvq/vpsrlvq move the value down by its own bit offset. Only the values
+// whose window lies inside the data are decoded, in multiples of four; the
+// number decoded is returned and the rest is left to unpack_bits.
+template <bool msb_first, bool is_signed>
+__attribute__((target("avx2"))) uint64_t unpack_bits_avx2(const uint8_t* data, uint64_t size, uint32_t width, uint64_t count, uint64_t* out)
+  {
+  const uint64_t safe_values = size >= 8 ? ((size - 7) * 8 + width - 1) / width : 0;
+  const uint64_t n = (count < safe_values ? count : safe_values) & ~3ull;
+  const __m256i step = _mm256_set1_epi64x(4 * (int64_t)width);
+  const __m256i seven = _mm256_set1_epi64x(7);
+  const __m256i mask = _mm256_set1_epi64x((int64_t)((~0ull) >> (64 - width)));
+  const __m256i sign_shift = _mm256_set1_epi64x(64 - width);
+  const __m256i sign = _mm256_set1_epi64x((int64_t)(1ull << (width - 1)));
+  const __m256i to_msb_first = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                                7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  __m256i bit = _mm256_setr_epi64x(0, width, 2 * (int64_t)width, 3 * (int64_t)width);
+  for (uint64_t i = 0; i < n; i += 4)
+    {
+    __m256i word = _mm256_i64gather_epi64((const long long*)data, _mm256_srli_epi64(bit, 3), 1);
+    const __m256i shift = _mm256_and_si256(bit, seven);
+    __m256i value;
+    if (msb_first)
+      value = _mm256_srlv_epi64(_mm256_sllv_epi64(_mm256_shuffle_epi8(word, to_msb_first), shift), sign_shift);
+    else
+      value = _mm256_and_si256(_mm256_srlv_epi64(word, shift), mask);
+    if (is_signed)
+      value = _mm256_sub_epi64(_mm256_xor_si256(value, sign), sign);
+    _mm256_storeu_si256((__m256i*)(out + i), value);
+    bit = _mm256_add_epi64(bit, step);
+    }
+  return n;
+  }
+#endif
+
+// Distance between x and the next representable number of a floating point
+// format with the given number of mantissa digits and minimum exponent.
+double float_ulp(double x, int digits, int min_exponent)
+  {
+  const int exponent = x == 0.0 ? min_exponent : std::max(std::ilogb(x), min_exponent);
+  return std::ldexp(1.0, exponent - (digits - 1));
+  }
+
+// Type traits of the registry. Every type has a value_type, a name and the
+// aliases the type command accepts, its width in bits (which may depend on
+// the state), the size of a unit in the last place around a value, and a
+// decode function that converts count consecutive values starting at first,
+// all lying before last, for a given endianness.
+template <class T, dumptype Id>
+struct scalar_type
+  {
+  typedef T value_type;
+  static constexpr dumptype id = Id;
+  static uint32_t bits(const hex_state&) { return 8 * sizeof(T); }
+
+  static double ulp(const hex_state&, double x)
+    {
+    if (std::is_integral<T>::value)
+      return 1.0;
+    return float_ulp(x, std::numeric_limits<T>::digits, std::numeric_limits<T>::min_exponent - 1);
+    }
+
+  template <bool little_endiann>
+  static void decode(const uint8_t* first, const uint8_t*, uint64_t count, const hex_state&, value_type* out)
+    {
+    for (uint64_t i = 0; i < count; ++i)
+      out[i] = load_scalar<T, little_endiann>(first + i * sizeof(T));
+    }
+  };
+
+struct type_uint8 : scalar_type<uint8_t, dumptype::dumptype_uint8> { static constexpr const char* name = "uint8_t"; static constexpr const char* aliases = "uint8 uint8_t B"; };
+struct type_int8 : scalar_type<int8_t, dumptype::dumptype_int8> { static constexpr const char* name = "int8_t"; static constexpr const char* aliases = "int8 int8_t b"; };
+struct type_uint16 : scalar_type<uint16_t, dumptype::dumptype_uint16> { static constexpr const char* name = "uint16_t"; static constexpr const char* aliases = "uint16 uint16_t H"; };
+struct type_int16 : scalar_type<int16_t, dumptype::dumptype_int16> { static constexpr const char* name = "int16_t"; static constexpr const char* aliases = "int16 int16_t h"; };
+struct type_uint32 : scalar_type<uint32_t, dumptype::dumptype_uint32> { static constexpr const char* name = "uint32_t"; static constexpr const char* aliases = "uint32 uint32_t I"; };
+struct type_int32 : scalar_type<int32_t, dumptype::dumptype_int32> { static constexpr const char* name = "int32_t"; static constexpr const char* aliases = "int32 int32_t i"; };
+struct type_uint64 : scalar_type<uint64_t, dumptype::dumptype_uint64> { static constexpr const char* name = "uint64_t"; static constexpr const char* aliases = "uint64 uint64_t Q"; };
+struct type_int64 : scalar_type<int64_t, dumptype::dumptype_int64> { static constexpr const char* name = "int64_t"; static constexpr const char* aliases = "int64 int64_t q"; };
+struct type_float : scalar_type<float, dumptype::dumptype_float> { static constexpr const char* name = "float"; static constexpr const char* aliases = "float f"; };
+struct type_double : scalar_type<double, dumptype::dumptype_double> { static constexpr const char* name = "double"; static constexpr const char* aliases = "double d"; };
+
+template <bool is_signed, dumptype Id>
+struct packed_type
+  {
+  typedef typename std::conditional<is_signed, int64_t, uint64_t>::type value_type;
+  static constexpr dumptype id = Id;
+  static uint32_t bits(const hex_state& state) { return state.bit_width; }
+  static double ulp(const hex_state&, double) { return 1.0; }
+
+  template <bool little_endiann>
+  static void decode(const uint8_t* first, const uint8_t* last, uint64_t count, const hex_state& state, value_type* out)
+    {
+    const uint64_t size = (uint64_t)(last - first);
+    uint64_t decoded = 0;
+#ifdef HEX_INTERPRET_AVX2
+    if (cpu_has_avx2())
+      decoded = state.msb_first ? unpack_bits_avx2<true, is_signed>(first, size, state.bit_width, count, (uint64_t*)out)
+                                : unpack_bits_avx2<false, is_signed>(first, size, state.bit_width, count, (uint64_t*)out);
+#endif
+    if (state.msb_first)
+      unpack_bits<true, is_signed>(first, size, state.bit_width, decoded, count - decoded, (uint64_t*)out + decoded);
+    else
+      unpack_bits<false, is_signed>(first, size, state.bit_width, decoded, count - decoded, (uint64_t*)out + decoded);
+    }
+  };
+
+struct type_ubits : packed_type<false, dumptype::dumptype_ubits> { static constexpr const char* name = "unsigned packed bits"; static constexpr const char* aliases = ""; };
+struct type_sbits : packed_type<true, dumptype::dumptype_sbits> { static constexpr const char* name = "signed packed bits"; static constexpr const char* aliases = ""; };
+
+struct type_fp16
+  {
+  typedef float value_type;
+  static constexpr dumptype id = dumptype::dumptype_fp16;
+  static constexpr const char* name = "fp16";
+  static constexpr const char* aliases = "fp16 half e";
+  static uint32_t bits(const hex_state&) { return 16; }
+  static double ulp(const hex_state&, double x) { return float_ulp(x, 11, -14); }
+
+  template <bool little_endiann>
+  static void decode(const uint8_t* first, const uint8_t*, uint64_t count, const hex_state&, value_type* out)
+    {
+#ifdef HEX_INTERPRET_F16C
+    if (cpu_has_f16c())
       {
-        ++i;
-        outputfile = arguments[i];
+      halves_to_floats_f16c<little_endiann != true>(first, count, out);
+      return;
       }
-      else if (arguments[i].find(">>") == 0)
+#endif
+    for (uint64_t i = 0; i < count; ++i)
+      out[i] = half_to_float(load_scalar<uint16_t, little_endiann>(first + 2 * i));
+    }
+  };
+
+struct type_bf16
+  {
+  typedef float value_type;
+  static constexpr dumptype id = dumptype::dumptype_bf16;
+  static constexpr const char* name = "bf16";
+  static constexpr const char* aliases = "bf16 bfloat16";
+  static uint32_t bits(const hex_state&) { return 16; }
+  static double ulp(const hex_state&, double x) { return float_ulp(x, 8, -126); }
+
+  template <bool little_endiann>
+  static void decode(const uint8_t* first, const uint8_t*, uint64_t count, const hex_state&, value_type* out)
+    {
+    for (uint64_t i = 0; i < count; ++i)
       {
-        arguments[i].erase(arguments[i].begin(), arguments[i].begin() + 2);
-        outputfile = arguments[i];
+      const uint32_t bits = (uint32_t)load_scalar<uint16_t, little_endiann>(first + 2 * i) << 16;
+      memcpy(out + i, &bits, sizeof(float));
       }
-      else if (arguments[i] == "endianness")
+    }
+  };
+
+template <bool is_signed, dumptype Id>
+struct int24_type
+  {
+  typedef typename std::conditional<is_signed, int32_t, uint32_t>::type value_type;
+  static constexpr dumptype id = Id;
+  static uint32_t bits(const hex_state&) { return 24; }
+  static double ulp(const hex_state&, double) { return 1.0; }
+
+  template <bool little_endiann>
+  static void decode(const uint8_t* first, const uint8_t*, uint64_t count, const hex_state&, value_type* out)
+    {
+    for (uint64_t i = 0; i < count; ++i)
       {
-        if (is_little_endian())
-          std::cout << "I detected little-endian" << std::endl;
-        else
-          std::cout << "I detected big-endian" << std::endl;
+      const uint8_t* p = first + 3 * i;
+      uint32_t value = little_endiann ? (p[0] | (p[1] << 8) | (p[2] << 16)) : (p[2] | (p[1] << 8) | (p[0] << 16));
+      if (is_signed)
+        value = (uint32_t)((int32_t)(value << 8) >> 8);
+      out[i] = (value_type)value;
       }
-      else if (arguments[i] == "state")
+    }
+  };
+
+struct type_uint24 : int24_type<false, dumptype::dumptype_uint24> { static constexpr const char* name = "uint24"; static constexpr const char* aliases = "uint24 uint24_t"; };
+struct type_int24 : int24_type<true, dumptype::dumptype_int24> { static constexpr const char* name = "int24"; static constexpr const char* aliases = "int24 int24_t"; };
+
+// Qm.n fixed point numbers: m + n bits (8, 16, 32 or 64) holding the value
+// times 2^n.
+template <bool is_signed, dumptype Id>
+struct fixed_point_type
+  {
+  typedef double value_type;
+  static constexpr dumptype id = Id;
+  static uint32_t bits(const hex_state& state) { return state.q_int_bits + state.q_frac_bits; }
+  static double ulp(const hex_state& state, double) { return std::ldexp(1.0, -(int)state.q_frac_bits); }
+
+  template <class TInt, bool little_endiann>
+  static void decode_fixed(const uint8_t* first, uint64_t count, double scale, value_type* out)
+    {
+    for (uint64_t i = 0; i < count; ++i)
+      out[i] = (double)load_scalar<TInt, little_endiann>(first + i * sizeof(TInt)) * scale;
+    }
+
+  template <bool little_endiann>
+  static void decode(const uint8_t* first, const uint8_t*, uint64_t count, const hex_state& state, value_type* out)
+    {
+    const double scale = std::ldexp(1.0, -(int)state.q_frac_bits);
+    switch (bits(state))
       {
-        if (state.little_endiann)
-          std::cout << "I interpret data as little-endian.\n";
-        else
-          std::cout << "I interpret data as big-endian.\n";
-        std::cout << "A dump will start at offset " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
-        if (state.length == 0xffffffff)
-          std::cout << "A dump will print untill the end of the given data.\n";
-        else
-          std::cout << "A dump will print " << state.length << "(0x" << int_to_hex(state.length) << ") bytes.\n";
-        std::cout << "Interpreting the bytes as " << dump_type_to_str(state.dump_type) << ".\n";
-        std::cout << state.data_per_line << " interpreted values will be printed per row.\n";
-        std::cout << "The input data is " << byte_arr.size() << " bytes long.\n";
+      case 8:
+        decode_fixed<typename std::conditional<is_signed, int8_t, uint8_t>::type, little_endiann>(first, count, scale, out);
+        break;
+      case 16:
+        decode_fixed<typename std::conditional<is_signed, int16_t, uint16_t>::type, little_endiann>(first, count, scale, out);
+        break;
+      case 32:
+        decode_fixed<typename std::conditional<is_signed, int32_t, uint32_t>::type, little_endiann>(first, count, scale, out);
+        break;
+      default:
+        decode_fixed<typename std::conditional<is_signed, int64_t, uint64_t>::type, little_endiann>(first, count, scale, out);
+        break;
       }
-      else if (arguments[i] == "dump" || arguments[i] == "d")
+    }
+  };
+
+struct type_ufixed : fixed_point_type<false, dumptype::dumptype_ufixed> { static constexpr const char* name = "unsigned fixed point"; static constexpr const char* aliases = ""; };
+struct type_fixed : fixed_point_type<true, dumptype::dumptype_fixed> { static constexpr const char* name = "signed fixed point"; static constexpr const char* aliases = ""; };
+
+template <class... TTypes>
+struct type_list {};
+
+// Must list the types in the order of the dumptype enumeration.
+typedef type_list<type_uint8, type_int8, type_uint16, type_int16, type_uint32, type_int32, type_uint64, type_int64,
+  type_float, type_double, type_ubits, type_sbits, type_fp16, type_bf16, type_uint24, type_int24, type_ufixed, type_fixed> registered_types;
+
+template <class T>
+T interpret_value(std::string_view s, std::false_type)
+  {
+  return (T)interpret_double(s);
+  }
+
+// Integers out of the range of T saturate to its limits, so a bound such
+// as 65535 for an int16_t reads as 32767 instead of wrapping to -1.
+template <class T>
+T interpret_value(std::string_view s, std::true_type)
+  {
+  if (!s.empty() && s[0] == '-')
+    {
+    const int64_t x = interpret_number<int64_t>(s);
+    return x < (int64_t)std::numeric_limits<T>::lowest() ? std::numeric_limits<T>::lowest() : (T)x;
+    }
+  const uint64_t x = interpret_number<uint64_t>(s);
+  return x > (uint64_t)std::numeric_limits<T>::max() ? std::numeric_limits<T>::max() : (T)x;
+  }
+
+template <class T>
+T interpret_value(std::string_view s)
+  {
+  return interpret_value<T>(s, std::is_integral<T>());
+  }
+
+// Rows are extended so that they end on a byte boundary, which keeps every
+// row of packed values independent.
+uint32_t bytes_per_row(uint32_t bits, uint32_t data_per_line)
+  {
+  uint32_t values_per_row = data_per_line ? data_per_line : 1;
+  while ((values_per_row * bits) % 8)
+    ++values_per_row;
+  return values_per_row * bits / 8;
+  }
+
+template <class TType>
+uint64_t number_of_values(const uint8_t* first, const uint8_t* last, const hex_state& state)
+  {
+  return (uint64_t)(last - first) * 8 / TType::bits(state);
+  }
+
+// Progress shared by several for_each_block calls of one job, such as the
+// parallel parts of a summary, which together pass over the data passes
+// times (once per bit lattice phase for clamp).
+struct block_progress
+  {
+  std::atomic<uint64_t> decoded{0};
+  uint32_t passes = 1;
+  };
+
+// Decodes the values in [first, last) in blocks of job_chunk_size values and
+// calls fun(values, count) for every block, until fun returns false or the
+// job is cancelled. Without shared progress the position in [first, last) is
+// reported.
+template <class TType, bool little_endiann, class TFun>
+void for_each_block(const uint8_t* first, const uint8_t* last, const hex_state& state, job_progress& progress, TFun fun, block_progress* shared = nullptr)
+  {
+  const uint32_t bits = TType::bits(state);
+  const uint64_t count = number_of_values<TType>(first, last, state);
+  std::vector<typename TType::value_type> values((size_t)std::min<uint64_t>(count, job_chunk_size));
+  for (uint64_t i = 0; i < count; i += job_chunk_size)
+    {
+    const uint64_t n = std::min<uint64_t>(job_chunk_size, count - i);
+    const uint64_t done = shared ? shared->decoded.fetch_add((i + n) * bits / 8 - i * bits / 8) / shared->passes : i * bits / 8;
+    if (report_progress(progress, done))
+      return;
+    TType::template decode<little_endiann>(first + i * bits / 8, last, n, state, values.data());
+    if (!fun(values.data(), n))
+      return;
+    }
+  }
+
+template <class TType, bool little_endiann>
+class ValueInterpreter
+  {
+  public:
+    ValueInterpreter(const hex_state& state) : _state(state) {}
+
+    void operator()(const std::vector<uint8_t>& characters, std::ostream& str)
       {
-        dump = true;
+      // reused between rows and dumps, so that dumping allocates nothing
+      static thread_local std::vector<typename TType::value_type> values;
+      const uint8_t* first = characters.data();
+      const uint8_t* last = first + characters.size();
+      values.resize(number_of_values<TType>(first, last, _state));
+      TType::template decode<little_endiann>(first, last, values.size(), _state, values.data());
+      for (auto value : values)
+        output(str, value);
       }
+
+  private:
+    const hex_state& _state;
+  };
+
+template <class TType, bool little_endiann>
+void dump_kernel(uint32_t address, const uint8_t* first, const uint8_t* last, const hex_state& state, job_progress& progress, std::ostream& str)
+  {
+  print_byte_array(address, first, last, ValueInterpreter<TType, little_endiann>(state), bytes_per_row(TType::bits(state), state.data_per_line), str, progress);
+  }
+
+template <class TType, bool little_endiann>
+void summary_kernel(const uint8_t* first, const uint8_t* last, const hex_state& state, job_progress& progress, std::ostream& str, bool json)
+  {
+  typedef typename TType::value_type T;
+  // the parts start at multiples of unit bytes, which hold a whole number of
+  // values, and are reduced into one summary afterwards
+  const uint64_t bits = TType::bits(state);
+  const uint64_t unit = bits / std::gcd<uint64_t>(bits, 8);
+  const uint64_t nr_of_units = (uint64_t)(last - first) / unit;
+  const uint32_t nr_of_parts = (uint32_t)std::min<uint64_t>(parallel_width(), (uint64_t)(last - first) / (16 * job_chunk_size) + 1);
+  std::vector<value_summary<T>> parts(nr_of_parts);
+  block_progress decoded;
+  parallel_for(nr_of_parts, nr_of_units, [&](uint32_t t, uint64_t first_unit, uint64_t last_unit) {
+    value_summary<T>& s = parts[t];
+    const uint8_t* part_last = t + 1 == nr_of_parts ? last : first + last_unit * unit;
+    for_each_block<TType, little_endiann>(first + first_unit * unit, part_last, state, progress, [&s](const T* values, uint64_t count) {
+      for (uint64_t i = 0; i < count; ++i)
+        {
+        const T value = values[i];
+        if (s.count == 0 || value < s.minimum)
+          s.minimum = value;
+        if (s.count == 0 || value > s.maximum)
+          s.maximum = value;
+        s.sum += (double)value;
+        ++s.count;
+        }
+      return true;
+      }, &decoded);
+    });
+  value_summary<T> s;
+  for (const auto& part : parts)
+    {
+    if (part.count == 0)
+      continue;
+    if (s.count == 0 || part.minimum < s.minimum)
+      s.minimum = part.minimum;
+    if (s.count == 0 || part.maximum > s.maximum)
+      s.maximum = part.maximum;
+    s.sum += part.sum;
+    s.count += part.count;
     }
-    if (dump) {
-      auto it = byte_arr.begin() + state.offset;
-      auto it_end = byte_arr.end();
-      if (state.length < byte_arr.size())
+  str.precision(std::numeric_limits<double>::max_digits10);
+  print_summary(s, str, json);
+  }
+
+template <class TType, bool little_endiann>
+void export_kernel(const uint8_t* first, const uint8_t* last, const hex_state& state, job_progress& progress, std::ostream& str)
+  {
+  typedef typename TType::value_type T;
+  str.precision(std::numeric_limits<T>::max_digits10);
+  for_each_block<TType, little_endiann>(first, last, state, progress, [&str](const T* values, uint64_t count) {
+    for (uint64_t i = 0; i < count; ++i)
+      str << +values[i] << "\n";
+    return true;
+    });
+  }
+
+template <class TType, bool little_endiann>
+void json_kernel(const uint8_t* first, const uint8_t* last, const hex_state& state, std::ostream& str)
+  {
+  typedef typename TType::value_type T;
+  str.precision(std::numeric_limits<T>::max_digits10);
+  str << "[";
+  bool first_value = true;
+  job_progress progress;
+  for_each_block<TType, little_endiann>(first, last, state, progress, [&str, &first_value](const T* values, uint64_t count) {
+    for (uint64_t i = 0; i < count; ++i)
       {
-        if ((uint64_t)state.length+(uint64_t)state.offset < byte_arr.size())
-          it_end = it + state.length;
+      if (!first_value)
+        str << ",";
+      first_value = false;
+      output_json(str, values[i]);
       }
-      std::ofstream f;
-      std::ostream* str = &std::cout;
-      if (!outputfile.empty())
+    return true;
+    });
+  str << "]";
+  }
+
+// Finds the first start byte after offset of length consecutive values in
+// [minimum, maximum]. Values starting at byte i lie on the bit lattice
+// 8 * i + k * bits, and the start bytes i, i + period, ... share a lattice,
+// so every lattice is scanned once, keeping the length of the current run.
+template <class TType, bool little_endiann>
+void clamp_kernel(uint32_t& offset, const std::vector<uint8_t>& byte_arr, const std::string& minimum_str, const std::string& maximum_str, uint32_t length, const hex_state& state, job_progress& progress, std::ostream& str)
+  {
+  typedef typename TType::value_type T;
+  const T minimum = interpret_value<T>(minimum_str);
+  const T maximum = interpret_value<T>(maximum_str);
+  str << "Looking for clamp of length " << length << " where data is in the interval [" << +minimum << ", " << +maximum << "]\n";
+  const uint32_t bits = TType::bits(state);
+  const uint32_t period = bits / std::gcd(bits, 8u);
+  const uint32_t values_per_start = 8 / std::gcd(bits, 8u);
+  const uint64_t first_start = (uint64_t)offset + 1;
+  const uint8_t* last = byte_arr.data() + byte_arr.size();
+  uint64_t best = std::numeric_limits<uint64_t>::max();
+  if (length == 0 && first_start < byte_arr.size())
+    best = first_start;
+  block_progress scanned;
+  scanned.passes = period;
+  for (uint32_t phase = 0; phase < period && length > 0; ++phase)
+    {
+    const uint64_t phase_start = first_start + phase;
+    if (phase_start >= byte_arr.size())
+      break;
+    const uint8_t* first = byte_arr.data() + phase_start;
+    uint64_t run_begin = 0;
+    uint64_t index = 0;
+    for_each_block<TType, little_endiann>(first, last, state, progress, [&](const T* values, uint64_t count) {
+      for (uint64_t i = 0; i < count; ++i, ++index)
+        {
+        if (!(values[i] >= minimum && values[i] <= maximum))
+          {
+          run_begin = index + 1;
+          continue;
+          }
+        // the run must start on a byte boundary
+        const uint64_t aligned_begin = (run_begin + values_per_start - 1) / values_per_start * values_per_start;
+        const uint64_t start = phase_start + aligned_begin * bits / 8;
+        if (start >= best)
+          return false;
+        if (index + 1 >= aligned_begin + length)
+          {
+          best = start;
+          return false;
+          }
+        }
+      return true;
+      }, &scanned);
+    if (progress.cancelled)
       {
-        f.open(outputfile);
-        if (f.is_open())
-          str = &f;
+      str << "Clamp search cancelled.\n";
+      return;
       }
-      uint32_t elements_per_row = state.data_per_line*size_of(state.dump_type);
-      switch (state.dump_type)
+    }
+  if (best < byte_arr.size())
+    {
+    str << "A valid offset has been found\n";
+    offset = (uint32_t)best;
+    }
+  }
+
+// Finds all positions where a value of the type equals value_str, testing
+// every byte alignment and, if both_orders is set, both byte orders in the
+// same pass. Integers match exactly and other types within half a unit in
+// the last place, unless a tolerance is given, either absolute or as a
+// number of units in the last place (4ulp). The data is split over all cores,
+// and every thread handles its part in blocks that stay in cache while all
+// alignments are decoded.
+template <class TType, bool little_endiann>
+void findval_kernel(const std::vector<uint8_t>& byte_arr, const std::string& value_str, const std::string& tolerance_str, bool both_orders, const hex_state& state, job_progress& progress, std::ostream& str, std::vector<uint32_t>& hits)
+  {
+  typedef typename TType::value_type T;
+  const uint32_t bits = TType::bits(state);
+  if (bits % 8)
+    {
+    str << "findval needs a type of whole bytes.\n";
+    return;
+    }
+  const uint32_t size = bits / 8;
+  // single bytes and packed bit streams have no byte order to swap
+  if (bits == 8 || is_bit_type(TType::id))
+    both_orders = false;
+  const double target = interpret_double(value_str);
+  const T exact = interpret_value<T>(value_str);
+  double tolerance = std::is_integral<T>::value ? 0.0 : 0.5 * TType::ulp(state, target);
+  if (tolerance_str.size() > 3 && tolerance_str.compare(tolerance_str.size() - 3, 3, "ulp") == 0)
+    tolerance = interpret_double(tolerance_str.substr(0, tolerance_str.size() - 3)) * TType::ulp(state, target);
+  else if (!tolerance_str.empty())
+    tolerance = interpret_double(tolerance_str);
+  const bool exact_match = tolerance == 0.0;
+  if (std::is_integral<T>::value && exact_match && (double)exact != target)
+    {
+    str << "The value " << value_str << " can't be stored in a " << TType::name << ".\n";
+    return;
+    }
+  str << "Looking for " << value_str;
+  if (!exact_match)
+    str << " +/- " << tolerance;
+  str << " at every alignment" << (both_orders ? " in both byte orders" : "") << ".\n";
+
+  const uint8_t* data = byte_arr.data();
+  const uint8_t* data_end = data + byte_arr.size();
+  const uint64_t nr_of_starts = byte_arr.size() >= size ? byte_arr.size() - size + 1 : 0;
+  const uint64_t block_size = job_chunk_size;
+  const uint32_t nr_of_threads = (uint32_t)std::min<uint64_t>(parallel_width(), nr_of_starts / block_size + 1);
+  std::vector<std::vector<uint32_t>> thread_hits(nr_of_threads), thread_swapped_hits(nr_of_threads);
+  std::atomic<uint64_t> done(0);
+  parallel_for(nr_of_threads, nr_of_starts, [&](uint32_t t, uint64_t first, uint64_t last) {
+    std::vector<T> values(block_size / size + 1), swapped(block_size / size + 1);
+    for (uint64_t block = first; block < last; block += block_size)
       {
-        case dumptype::dumptype_uint8:
-          print_byte_array(state.offset, it, it_end, TypeInterpreter<uint8_t>(state.little_endiann), elements_per_row, *str);
-          break;
-        case dumptype::dumptype_int8:
-          print_byte_array(state.offset, it, it_end, TypeInterpreter<int8_t>(state.little_endiann), elements_per_row, *str);
-          break;
-        case dumptype::dumptype_uint16:
-          print_byte_array(state.offset, it, it_end, TypeInterpreter<uint16_t>(state.little_endiann), elements_per_row, *str);
-          break;
-        case dumptype::dumptype_int16:
-          print_byte_array(state.offset, it, it_end, TypeInterpreter<int16_t>(state.little_endiann), elements_per_row, *str);
-          break;
-        case dumptype::dumptype_uint32:
-          print_byte_array(state.offset, it, it_end, TypeInterpreter<uint32_t>(state.little_endiann), elements_per_row, *str);
-          break;
-        case dumptype::dumptype_int32:
-          print_byte_array(state.offset, it, it_end, TypeInterpreter<int32_t>(state.little_endiann), elements_per_row, *str);
-          break;
-        case dumptype::dumptype_uint64:
-          print_byte_array(state.offset, it, it_end, TypeInterpreter<uint64_t>(state.little_endiann), elements_per_row, *str);
-          break;
-        case dumptype::dumptype_int64:
-          print_byte_array(state.offset, it, it_end, TypeInterpreter<int64_t>(state.little_endiann), elements_per_row, *str);
-          break;
-        case dumptype::dumptype_float:
-          print_byte_array(state.offset, it, it_end, TypeInterpreter<float>(state.little_endiann), elements_per_row, *str);
-          break;
-        case dumptype::dumptype_double:
-          print_byte_array(state.offset, it, it_end, TypeInterpreter<double>(state.little_endiann), elements_per_row, *str);
-          break;
+      if (report_progress(progress, done += std::min<uint64_t>(block_size, last - block)))
+        return;
+      const uint64_t block_end = std::min<uint64_t>(block + block_size, last);
+      for (uint32_t phase = 0; phase < size && block + phase < block_end; ++phase)
+        {
+        const uint64_t start = block + phase;
+        const uint64_t count = (block_end - start + size - 1) / size;
+        TType::template decode<little_endiann>(data + start, data_end, count, state, values.data());
+        if (both_orders)
+          TType::template decode<!little_endiann>(data + start, data_end, count, state, swapped.data());
+        for (uint64_t k = 0; k < count; ++k)
+          {
+          const bool match = exact_match ? values[k] == exact : std::fabs((double)values[k] - target) <= tolerance;
+          if (match)
+            thread_hits[t].push_back((uint32_t)(start + k * size));
+          }
+        for (uint64_t k = 0; both_orders && k < count; ++k)
+          {
+          const bool match = exact_match ? swapped[k] == exact : std::fabs((double)swapped[k] - target) <= tolerance;
+          if (match)
+            thread_swapped_hits[t].push_back((uint32_t)(start + k * size));
+          }
+        }
+      }
+    });
+  if (progress.cancelled)
+    {
+    str << "Value search cancelled.\n";
+    return;
+    }
+  uint64_t nr_of_swapped_hits = 0;
+  for (uint32_t t = 0; t < nr_of_threads; ++t)
+    {
+    hits.insert(hits.end(), thread_hits[t].begin(), thread_hits[t].end());
+    hits.insert(hits.end(), thread_swapped_hits[t].begin(), thread_swapped_hits[t].end());
+    nr_of_swapped_hits += thread_swapped_hits[t].size();
+    }
+  std::sort(hits.begin(), hits.end());
+  hits.erase(std::unique(hits.begin(), hits.end()), hits.end());
+  print_hits(hits, str);
+  if (both_orders)
+    str << nr_of_swapped_hits << " of the matches are in the " << (little_endiann ? "big" : "little") << " endian byte order.\n";
+  }
+
+// Kernels of one (type, endianness) pair, instantiated once by the registry.
+struct type_kernels
+  {
+  const char* name;
+  const char* aliases;
+  uint32_t (*bits)(const hex_state&);
+  void (*dump)(uint32_t, const uint8_t*, const uint8_t*, const hex_state&, job_progress&, std::ostream&);
+  void (*summary)(const uint8_t*, const uint8_t*, const hex_state&, job_progress&, std::ostream&, bool);
+  void (*export_values)(const uint8_t*, const uint8_t*, const hex_state&, job_progress&, std::ostream&);
+  void (*json_values)(const uint8_t*, const uint8_t*, const hex_state&, std::ostream&);
+  void (*clamp)(uint32_t&, const std::vector<uint8_t>&, const std::string&, const std::string&, uint32_t, const hex_state&, job_progress&, std::ostream&);
+  void (*findval)(const std::vector<uint8_t>&, const std::string&, const std::string&, bool, const hex_state&, job_progress&, std::ostream&, std::vector<uint32_t>&);
+  };
+
+template <class TType, bool little_endiann>
+constexpr type_kernels make_type_kernels()
+  {
+  return type_kernels{ TType::name, TType::aliases, &TType::bits,
+    &dump_kernel<TType, little_endiann>,
+    &summary_kernel<TType, little_endiann>,
+    &export_kernel<TType, little_endiann>,
+    &json_kernel<TType, little_endiann>,
+    &clamp_kernel<TType, little_endiann>,
+    &findval_kernel<TType, little_endiann> };
+  }
+
+template <class... TTypes>
+constexpr std::array<std::array<type_kernels, 2>, sizeof...(TTypes)> make_type_table(type_list<TTypes...>)
+  {
+  return {{ {{ make_type_kernels<TTypes, false>(), make_type_kernels<TTypes, true>() }}... }};
+  }
+
+template <class... TTypes>
+constexpr bool types_follow_dumptype_order(type_list<TTypes...>)
+  {
+  size_t index = 0;
+  bool in_order = true;
+  ((in_order = in_order && (size_t)TTypes::id == index++), ...);
+  return in_order;
+  }
+
+static_assert(types_follow_dumptype_order(registered_types()), "registered_types must follow the order of dumptype");
+
+constexpr auto type_table = make_type_table(registered_types());
+
+const type_kernels& kernels_of(const hex_state& state)
+  {
+  return type_table[(size_t)state.dump_type][state.little_endiann ? 1 : 0];
+  }
+
+uint32_t bytes_per_row(const hex_state& state)
+  {
+  return bytes_per_row(kernels_of(state).bits(state), state.data_per_line);
+  }
+
+std::string dump_type_to_str(const hex_state& state)
+  {
+  std::stringstream sstr;
+  if (state.dump_type == dumptype::dumptype_ubits || state.dump_type == dumptype::dumptype_sbits)
+    sstr << (state.dump_type == dumptype::dumptype_sbits ? "s" : "u") << state.bit_width << " (packed, " << (state.msb_first ? "msb" : "lsb") << " first)";
+  else if (state.dump_type == dumptype::dumptype_ufixed || state.dump_type == dumptype::dumptype_fixed)
+    sstr << (state.dump_type == dumptype::dumptype_ufixed ? "uq" : "q") << state.q_int_bits << "." << state.q_frac_bits << " (fixed point)";
+  else
+    sstr << kernels_of(state).name;
+  return sstr.str();
+  }
+
+bool has_alias(const char* aliases, const std::string& s)
+  {
+  std::stringstream sstr(aliases);
+  std::string alias;
+  while (sstr >> alias)
+    {
+    if (alias == s)
+      return true;
+    }
+  return false;
+  }
+
+// Parses a type argument into the state: one of the aliases of the registered
+// types, u<N> or s<N> for packed values of N bits, or q<m>.<n> or uq<m>.<n>
+// for fixed point numbers of m + n bits. Returns false for an unknown type.
+bool interpret_type(const std::string& s, hex_state& state)
+  {
+  if (s.size() > 1 && (s[0] == 'u' || s[0] == 's') && s.find_first_not_of("0123456789", 1) == std::string::npos)
+    {
+    const uint32_t width = interpret_number(s.substr(1));
+    if (width < 1 || width > max_bit_width)
+      return false;
+    state.dump_type = s[0] == 'u' ? dumptype::dumptype_ubits : dumptype::dumptype_sbits;
+    state.bit_width = width;
+    return true;
+    }
+  const size_t q = s.find('q');
+  const size_t dot = s.find('.');
+  if ((q == 0 || (q == 1 && s[0] == 'u')) && dot != std::string::npos && dot > q + 1 && dot + 1 < s.size() &&
+      s.find_first_not_of("0123456789", q + 1) == dot && s.find_first_not_of("0123456789", dot + 1) == std::string::npos)
+    {
+    const uint32_t int_bits = interpret_number(s.substr(q + 1, dot - q - 1));
+    const uint32_t frac_bits = interpret_number(s.substr(dot + 1));
+    const uint32_t bits = int_bits + frac_bits;
+    if (bits != 8 && bits != 16 && bits != 32 && bits != 64)
+      return false;
+    state.dump_type = q == 0 ? dumptype::dumptype_fixed : dumptype::dumptype_ufixed;
+    state.q_int_bits = int_bits;
+    state.q_frac_bits = frac_bits;
+    return true;
+    }
+  for (size_t t = 0; t < type_table.size(); ++t)
+    {
+    if (has_alias(type_table[t][0].aliases, s))
+      {
+      state.dump_type = (dumptype)t;
+      return true;
       }
-      if (f.is_open())
-        f.close();
     }
-    
+  return false;
   }
+
+void find_clamp(uint32_t& offset, const std::vector<uint8_t>& byte_arr, const std::string& minimum_str, const std::string& maximum_str, const std::string& length_str, const hex_state& state, job_progress& progress, std::ostream& str) {
+  kernels_of(state).clamp(offset, byte_arr, minimum_str, maximum_str, interpret_number(length_str), state, progress, str);
 }
 
-int main(int argc, char** argv)
-{
-  if (argc > 1)
+void find_value(const std::vector<uint8_t>& byte_arr, const std::string& value_str, const std::string& tolerance_str, bool both_orders, const hex_state& state, job_progress& progress, std::ostream& str, std::vector<uint32_t>& hits)
+  {
+  kernels_of(state).findval(byte_arr, value_str, tolerance_str, both_orders, state, progress, str, hits);
+  }
+
+void summary_data(const uint8_t* first, const uint8_t* last, const hex_state& state, job_progress& progress, std::ostream& str, bool json)
+  {
+  kernels_of(state).summary(first, last, state, progress, str, json);
+  }
+
+// Writes the values in [first, last) in the current type, one per line.
+void export_data(const uint8_t* first, const uint8_t* last, const hex_state& state, job_progress& progress, std::ostream& str)
+  {
+  kernels_of(state).export_values(first, last, state, progress, str);
+  }
+
+const char search_index_magic[8] = { 'H', 'E', 'X', 'I', 'D', 'X', '0', '1' };
+const uint32_t search_index_gram_size = 4;
+
+struct search_index_header
+  {
+  char magic[8];
+  uint64_t source_size;
+  uint64_t source_hash;
+  uint32_t gram_size;
+  uint32_t step;
+  uint32_t bucket_bits;
+  uint32_t reserved;
+  };
+
+// Sampled q-gram index: for every position p that is a multiple of step, p is
+// stored in the posting list of the bucket of the 4 bytes starting at p. The
+// sidecar file is the header, followed by 2^bucket_bits + 1 offsets into the
+// posting lists, followed by the posting lists. It is memory mapped when the
+// platform allows it.
+class search_index
+  {
+  public:
+    search_index() {}
+    search_index(const search_index&) = delete;
+    search_index& operator=(const search_index&) = delete;
+
+    ~search_index()
+      {
+#ifndef _WIN32
+      if (_mapping)
+        munmap(_mapping, _mapping_size);
+#endif
+      }
+
+    const search_index_header& header() const { return *reinterpret_cast<const search_index_header*>(data()); }
+    const uint32_t* bucket_offsets() const { return reinterpret_cast<const uint32_t*>(data() + sizeof(search_index_header)); }
+    const uint32_t* postings() const { return bucket_offsets() + (1ull << header().bucket_bits) + 1; }
+    uint64_t memory_size() const { return _mapping ? _mapping_size : _storage.size(); }
+    bool is_mapped() const { return _mapping != nullptr; }
+
+    std::vector<uint8_t> _storage;
+    void* _mapping = nullptr;
+    size_t _mapping_size = 0;
+
+  private:
+    const uint8_t* data() const { return _mapping ? (const uint8_t*)_mapping : _storage.data(); }
+  };
+
+uint32_t gram_bucket(const uint8_t* p, uint32_t bucket_bits)
+  {
+  uint32_t gram;
+  memcpy(&gram, p, sizeof(gram));
+  return (uint32_t)(gram * 2654435761u) >> (32 - bucket_bits);
+  }
+
+std::string search_index_filename(const std::string& input)
+  {
+  return input + ".hexidx";
+  }
+
+// Builds the index with one thread per core: every thread first counts the
+// bucket sizes of its part of the input, and after a prefix sum writes its
+// positions, so that every posting list ends up sorted.
+std::shared_ptr<const search_index> build_search_index(const std::vector<uint8_t>& byte_arr, uint32_t step, job_progress& progress, std::ostream& str)
+  {
+  const auto start = std::chrono::steady_clock::now();
+  const uint32_t q = search_index_gram_size;
+  if (step == 0)
+    step = 1;
+  const uint64_t nr_of_positions = byte_arr.size() >= q ? (byte_arr.size() - q) / step + 1 : 0;
+  uint32_t bucket_bits = 12;
+  while (bucket_bits < 22 && (1ull << (bucket_bits + 2)) < nr_of_positions)
+    ++bucket_bits;
+  const uint64_t nr_of_buckets = 1ull << bucket_bits;
+  // every thread counts into its own array of nr_of_buckets entries, so the
+  // number of threads is limited to keep these arrays within 64 MB together
+  const uint64_t max_count_memory = 1ull << 26;
+  const uint32_t nr_of_threads = (uint32_t)std::max<uint64_t>(1, std::min<uint64_t>(parallel_width(), max_count_memory / (nr_of_buckets * sizeof(uint32_t))));
+
+  auto index = std::make_shared<search_index>();
+  index->_storage.resize(sizeof(search_index_header) + (nr_of_buckets + 1 + nr_of_positions) * sizeof(uint32_t));
+  search_index_header header;
+  memcpy(header.magic, search_index_magic, sizeof(header.magic));
+  header.source_size = byte_arr.size();
+  header.source_hash = hash_range(byte_arr.data(), byte_arr.data() + byte_arr.size(), progress);
+  if (progress.cancelled)
+    return nullptr;
+  header.gram_size = q;
+  header.step = step;
+  header.bucket_bits = bucket_bits;
+  header.reserved = 0;
+  memcpy(index->_storage.data(), &header, sizeof(header));
+  uint32_t* offsets = reinterpret_cast<uint32_t*>(index->_storage.data() + sizeof(search_index_header));
+  uint32_t* postings = offsets + nr_of_buckets + 1;
+
+  std::vector<std::vector<uint32_t>> counts(nr_of_threads, std::vector<uint32_t>(nr_of_buckets, 0));
+  std::atomic<uint64_t> done(0);
+  parallel_for(nr_of_threads, nr_of_positions, [&](uint32_t t, uint64_t first, uint64_t last) {
+    std::vector<uint32_t>& count = counts[t];
+    for (uint64_t i = first; i < last; ++i)
+      {
+      if ((i - first) % job_chunk_size == 0 && report_progress(progress, byte_arr.size() + (done += job_chunk_size) * step))
+        return;
+      ++count[gram_bucket(byte_arr.data() + i * step, bucket_bits)];
+      }
+    });
+  if (progress.cancelled)
+    return nullptr;
+  uint32_t total = 0;
+  for (uint64_t b = 0; b < nr_of_buckets; ++b)
+    {
+    offsets[b] = total;
+    for (uint32_t t = 0; t < nr_of_threads; ++t)
+      {
+      const uint32_t c = counts[t][b];
+      counts[t][b] = total;
+      total += c;
+      }
+    }
+  offsets[nr_of_buckets] = total;
+  parallel_for(nr_of_threads, nr_of_positions, [&](uint32_t t, uint64_t first, uint64_t last) {
+    std::vector<uint32_t>& next = counts[t];
+    for (uint64_t i = first; i < last; ++i)
+      {
+      if ((i - first) % job_chunk_size == 0 && report_progress(progress, byte_arr.size() + (done += job_chunk_size) * step))
+        return;
+      postings[next[gram_bucket(byte_arr.data() + i * step, bucket_bits)]++] = (uint32_t)(i * step);
+      }
+    });
+  if (progress.cancelled)
+    return nullptr;
+  const auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  str << "Built a search index of " << nr_of_positions << " positions (every " << step << " byte" << (step == 1 ? "" : "s") << ") in " << milliseconds << " ms using " << nr_of_threads << " thread" << (nr_of_threads == 1 ? "" : "s") << ".\n";
+  str << "The index uses " << index->memory_size() << " bytes of memory.\n";
+  return index;
+  }
+
+bool write_search_index(const search_index& index, const std::string& filename)
+  {
+  std::ofstream f(filename, std::ofstream::out | std::ofstream::binary);
+  if (!f.is_open())
+    return false;
+  f.write((const char*)index._storage.data(), index._storage.size());
+  return f.good();
+  }
+
+// Loads the sidecar index of the input, or returns nullptr if there is none
+// or it was built for different data.
+std::shared_ptr<const search_index> load_search_index(const std::string& filename, const std::vector<uint8_t>& byte_arr, std::ostream& str)
+  {
+  auto index = std::make_shared<search_index>();
+#ifdef _WIN32
+  std::ifstream f(filename, std::ifstream::in | std::ifstream::binary);
+  if (!f.is_open())
+    return nullptr;
+  index->_storage.assign(std::istreambuf_iterator<char>(f), {});
+  const uint64_t file_size = index->_storage.size();
+#else
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat st;
+  const uint64_t file_size = fstat(fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+  if (file_size >= sizeof(search_index_header))
+    {
+    void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED)
+      {
+      index->_mapping = mapping;
+      index->_mapping_size = file_size;
+      }
+    }
+  close(fd);
+  if (!index->is_mapped())
+    return nullptr;
+#endif
+  if (file_size < sizeof(search_index_header) + sizeof(uint32_t))
+    return nullptr;
+  const search_index_header& header = index->header();
+  const uint64_t nr_of_buckets = 1ull << header.bucket_bits;
+  if (memcmp(header.magic, search_index_magic, sizeof(header.magic)) != 0 || header.gram_size != search_index_gram_size ||
+      header.step == 0 || header.bucket_bits < 1 || header.bucket_bits > 30 ||
+      file_size < sizeof(search_index_header) + (nr_of_buckets + 1) * sizeof(uint32_t) ||
+      file_size != sizeof(search_index_header) + (nr_of_buckets + 1 + index->bucket_offsets()[nr_of_buckets]) * sizeof(uint32_t))
+    {
+    str << "Ignoring search index " << filename << ": the file is invalid.\n";
+    return nullptr;
+    }
+  const uint32_t* offsets = index->bucket_offsets();
+  for (uint64_t b = 0; b < nr_of_buckets; ++b)
+    {
+    if (offsets[b] > offsets[b + 1])
+      {
+      str << "Ignoring search index " << filename << ": the file is invalid.\n";
+      return nullptr;
+      }
+    }
+  job_progress progress;
+  if (header.source_size != byte_arr.size() || header.source_hash != hash_range(byte_arr.data(), byte_arr.data() + byte_arr.size(), progress))
+    {
+    str << "Ignoring search index " << filename << ": it was built for different data.\n";
+    return nullptr;
+    }
+  str << "Using search index " << filename << " (" << index->memory_size() << " bytes" << (index->is_mapped() ? ", memory mapped" : "") << ").\n";
+  return index;
+  }
+
+// Finds all occurrences of find_arr with the index. Every occurrence at x has
+// exactly one window j < step with x + j a sampled position, so looking up the
+// first step windows of the needle finds all of them. Returns false if the
+// needle is too short for the sampling step.
+bool index_find_all(const search_index& index, const std::vector<uint8_t>& byte_arr, const std::vector<uint8_t>& find_arr, std::vector<uint32_t>& hits)
+  {
+  const search_index_header& header = index.header();
+  if (find_arr.size() < header.gram_size + header.step - 1)
+    return false;
+  const uint32_t* offsets = index.bucket_offsets();
+  const uint32_t* postings = index.postings();
+  hits.clear();
+  for (uint32_t j = 0; j < header.step; ++j)
+    {
+    const uint32_t bucket = gram_bucket(find_arr.data() + j, header.bucket_bits);
+    for (uint32_t k = offsets[bucket]; k < offsets[bucket + 1]; ++k)
+      {
+      const uint32_t p = postings[k];
+      if (p < j)
+        continue;
+      const uint64_t x = p - j;
+      if (x + find_arr.size() <= byte_arr.size() && memcmp(byte_arr.data() + x, find_arr.data(), find_arr.size()) == 0)
+        hits.push_back((uint32_t)x);
+      }
+    }
+  if (header.step > 1)
+    std::sort(hits.begin(), hits.end());
+  return true;
+  }
+
+void print_index_state(const std::shared_ptr<const search_index>& index, std::ostream& str)
+  {
+  if (!index)
+    {
+    str << "There is no search index, use index build [step] to create one.\n";
+    return;
+    }
+  const search_index_header& header = index->header();
+  str << "The search index samples every " << header.step << " byte" << (header.step == 1 ? "" : "s") << " with " << (1ull << header.bucket_bits) << " buckets.\n";
+  str << "It uses " << index->memory_size() << " bytes" << (index->is_mapped() ? ", memory mapped" : "") << ", and finds needles of at least " << header.gram_size + header.step - 1 << " bytes.\n";
+  }
+
+void select_next_hit(uint32_t& offset, const std::vector<uint32_t>& hits, std::ostream& str)
+  {
+  auto it = std::upper_bound(hits.begin(), hits.end(), offset);
+  if (it == hits.end())
+    it = hits.begin();
+  if (it == hits.end())
+    {
+    str << "Found no occurrence.\n";
+    return;
+    }
+  str << "Found next occurence at position 0x" << int_to_hex(*it) << ".\n";
+  offset = *it;
+  str << "Setting offset to " << offset << "(0x" << int_to_hex(offset) << ").\n";
+  }
+
+uint64_t dump_size(uint32_t offset, const std::vector<uint8_t>& byte_arr, const hex_state& state)
+{
+  if (offset >= byte_arr.size())
+    return 0;
+  uint64_t size = byte_arr.size() - offset;
+  return state.length < size ? state.length : size;
+}
+
+void dump_data(uint32_t offset, const std::vector<uint8_t>& byte_arr, const hex_state& state, job_progress& progress, std::ostream& str)
+{
+  const uint8_t* first = byte_arr.data() + (offset < byte_arr.size() ? offset : byte_arr.size());
+  kernels_of(state).dump(offset, first, first + dump_size(offset, byte_arr, state), state, progress, str);
+}
+
+// A find, clamp or dump running on a worker thread. Foreground jobs block the
+// prompt until they finish or Ctrl-C is pressed, background jobs (commands
+// ending in &) buffer their output until the prompt collects them.
+struct hex_job
+{
+  uint32_t id = 0;
+  std::string description;
+  job_progress progress;
+  uint32_t start_offset = 0;
+  uint32_t offset = 0;
+  std::stringstream output;
+  std::ostream* str = &output;
+  std::ofstream file;
+  std::shared_ptr<const std::vector<uint32_t>> hits;
+  std::vector<uint8_t> needle;
+  std::shared_ptr<const search_index> index;
+  std::atomic<bool> finished{false};
+  std::thread worker;
+};
+
+std::string progress_to_str(const job_progress& progress);
+
+// Shows the progress of the foreground job on the console once it runs for
+// more than a second. One thread serves all jobs of a command loop, it waits
+// on a condition variable that is signalled when a job starts or ends.
+class progress_display
+{
+public:
+  ~progress_display()
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _condition.notify_all();
+    if (_thread.joinable())
+      _thread.join();
+  }
+
+  void begin(const job_progress& progress)
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_thread.joinable())
+      _thread = std::thread([this]() { run(); });
+    _progress = &progress;
+    _shown = false;
+    _condition.notify_all();
+  }
+
+  void end()
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _progress = nullptr;
+    if (_shown)
+      std::cout << "\n";
+    _condition.notify_all();
+  }
+
+private:
+  void run()
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop)
+    {
+      const job_progress* progress = _progress;
+      if (!progress)
+      {
+        _condition.wait(lock);
+        continue;
+      }
+      if (_condition.wait_for(lock, std::chrono::milliseconds(250), [&]() { return _stop || _progress != progress; }))
+        continue;
+      if (std::chrono::steady_clock::now() - progress->start > std::chrono::seconds(1))
+      {
+        std::cout << "\r" << progress_to_str(*progress) << "    " << std::flush;
+        _shown = true;
+      }
+    }
+  }
+
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  const job_progress* _progress = nullptr;
+  bool _shown = false;
+  bool _stop = false;
+  std::thread _thread;
+};
+
+// Background jobs run on their own thread, foreground jobs on the thread of
+// the command loop. The batch mode sets run_inline, which runs every job in
+// the foreground without a progress display.
+struct job_list
+{
+  std::list<std::unique_ptr<hex_job>> jobs;
+  uint32_t next_id = 1;
+  std::ostream* out = &std::cout;
+  bool run_inline = false;
+  progress_display display;
+
+  ~job_list()
+  {
+    for (auto& job : jobs)
+    {
+      job->progress.cancelled = true;
+      job->worker.join();
+    }
+  }
+};
+
+std::string progress_to_str(const job_progress& progress)
+{
+  const uint64_t done = progress.done;
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - progress.start).count();
+  const double rate = seconds > 0.0 ? done / seconds : 0.0;
+  std::stringstream sstr;
+  sstr << done << "/" << progress.total << " bytes";
+  if (progress.total)
+    sstr << " (" << (100 * done / progress.total) << "%)";
+  sstr << ", " << (uint64_t)(rate / (1024.0 * 1024.0)) << " MB/s";
+  if (rate > 0.0 && progress.total >= done)
+    sstr << ", ETA " << (uint64_t)((progress.total - done) / rate) << "s";
+  return sstr.str();
+}
+
+std::unique_ptr<hex_job> make_job(const std::string& description, const hex_state& state)
+{
+  std::unique_ptr<hex_job> job(new hex_job());
+  job->description = description;
+  job->start_offset = state.offset;
+  job->offset = state.offset;
+  job->progress.interrupt_generation = interrupt_count;
+  return job;
+}
+
+void finish_job(hex_job& job, hex_state& state, bool background, std::ostream& out)
+{
+  if (job.worker.joinable())
+    job.worker.join();
+  if (background)
+  {
+    if (job.progress.cancelled)
+      out << "[" << job.id << "] cancelled: " << job.description << "\n";
+    else
+      out << "[" << job.id << "] done: " << job.description << "\n";
+  }
+  if (job.str == &job.output)
+    out << job.output.str();
+  if (job.offset != job.start_offset && !job.progress.cancelled)
+    state.offset = job.offset;
+  if (job.hits && !job.progress.cancelled)
+  {
+    state.hits = job.hits;
+    state.hits_needle = job.needle;
+  }
+  if (job.index && !job.progress.cancelled)
+    state.index = job.index;
+}
+
+void run_job(job_list& jobs, std::unique_ptr<hex_job> job, hex_state& state, bool background, std::function<void(hex_job&)> work)
+{
+  job->id = jobs.next_id++;
+  hex_job* j = job.get();
+  if (background && !jobs.run_inline)
+  {
+    ++interrupt_listeners;
+    j->worker = std::thread([j, work]() {
+      work(*j);
+      j->finished = true;
+      --interrupt_listeners;
+      });
+    std::cout << "[" << j->id << "] started: " << j->description << "\n";
+    jobs.jobs.push_back(std::move(job));
+    return;
+  }
+  interrupt_listener listener;
+  const bool show_progress = !jobs.run_inline && j->str != jobs.out;
+  if (show_progress)
+    jobs.display.begin(j->progress);
+  work(*j);
+  j->finished = true;
+  if (show_progress)
+    jobs.display.end();
+  finish_job(*j, state, false, *jobs.out);
+}
+
+void collect_finished_jobs(job_list& jobs, hex_state& state)
+{
+  for (auto it = jobs.jobs.begin(); it != jobs.jobs.end();)
+  {
+    if ((*it)->finished)
+    {
+      finish_job(**it, state, true, *jobs.out);
+      it = jobs.jobs.erase(it);
+    }
+    else
+      ++it;
+  }
+}
+
+void print_jobs(const job_list& jobs)
+{
+  if (jobs.jobs.empty())
+    *jobs.out << "No background jobs are running.\n";
+  for (const auto& job : jobs.jobs)
+    *jobs.out << "[" << job->id << "] " << job->description << ": " << progress_to_str(job->progress) << "\n";
+}
+
+void cancel_jobs(job_list& jobs, uint32_t id)
+{
+  bool found = false;
+  for (auto& job : jobs.jobs)
+  {
+    if (id == 0 || job->id == id)
+    {
+      if (!job->finished)
+        job->progress.cancelled = true;
+      found = true;
+    }
+  }
+  if (!found)
+    *jobs.out << "No such job.\n";
+}
+
+#ifdef __linux__
+// Waits for the file to be written to, or for the timeout to pass.
+class file_watcher
+{
+public:
+  file_watcher(const std::string& filename)
+  {
+    _fd = inotify_init1(IN_NONBLOCK);
+    if (_fd >= 0 && inotify_add_watch(_fd, filename.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB) < 0)
+    {
+      close(_fd);
+      _fd = -1;
+    }
+  }
+
+  ~file_watcher()
+  {
+    if (_fd >= 0)
+      close(_fd);
+  }
+
+  bool uses_notifications() const { return _fd >= 0; }
+
+  void wait(std::chrono::milliseconds timeout)
+  {
+    if (_fd < 0)
+    {
+      std::this_thread::sleep_for(timeout);
+      return;
+    }
+    pollfd p;
+    p.fd = _fd;
+    p.events = POLLIN;
+    if (poll(&p, 1, (int)timeout.count()) > 0)
+    {
+      char events[4096];
+      while (read(_fd, events, sizeof(events)) > 0)
+        ;
+    }
+  }
+
+private:
+  int _fd;
+};
+#else
+// Polling fallback for platforms without inotify.
+class file_watcher
+{
+public:
+  file_watcher(const std::string&) {}
+  bool uses_notifications() const { return false; }
+  void wait(std::chrono::milliseconds timeout) { std::this_thread::sleep_for(timeout); }
+};
+#endif
+
+// Appends the bytes that are written to the input file to byte_arr until
+// Ctrl-C is pressed. Every complete row of new data is dumped in the current
+// type, and the last find needle is searched for in the new bytes only, with
+// an overlap of the needle length minus one with the data seen before.
+void follow_file(const std::string& filename, std::vector<uint8_t>& byte_arr, hex_state& state)
+{
+  std::ifstream f(filename, std::ifstream::in | std::ifstream::binary);
+  if (!f.is_open())
+  {
+    std::cout << "Follow needs a binary input file.\n";
+    return;
+  }
+  file_watcher watcher(filename);
+  std::cout << "Following " << filename << (watcher.uses_notifications() ? "" : " by polling") << ", press Ctrl-C to stop.\n";
+  const std::vector<uint8_t> needle = state.find_needle;
+  std::shared_ptr<std::vector<uint32_t>> hits;
+  if (state.hits && state.hits_needle == needle)
+    hits = std::make_shared<std::vector<uint32_t>>(*state.hits);
+  else
+    hits = std::make_shared<std::vector<uint32_t>>();
+  const uint32_t elements_per_row = bytes_per_row(state);
+  uint64_t dumped_until = byte_arr.size();
+  interrupt_listener listener;
+  job_progress progress;
+  progress.interrupt_generation = interrupt_count;
+  while (progress.interrupt_generation == interrupt_count)
+  {
+    watcher.wait(std::chrono::milliseconds(250));
+    f.clear();
+    f.seekg(0, std::ifstream::end);
+    const uint64_t file_size = (uint64_t)f.tellg();
+    if (file_size < byte_arr.size())
+    {
+      std::cout << "The file was truncated, stopped following.\n";
+      break;
+    }
+    if (file_size == byte_arr.size())
+      continue;
+    const uint64_t old_size = byte_arr.size();
+    byte_arr.resize(file_size);
+    f.seekg(old_size);
+    f.read((char*)byte_arr.data() + old_size, file_size - old_size);
+    byte_arr.resize(old_size + (uint64_t)f.gcount());
+    if (state.index)
+    {
+      std::cout << "The search index no longer matches the data, it won't be used.\n";
+      state.index.reset();
+    }
+    const uint64_t rows = (byte_arr.size() - dumped_until) / elements_per_row;
+    if (rows)
+    {
+      hex_state row_state = state;
+      row_state.length = (uint32_t)(rows * elements_per_row);
+      dump_data((uint32_t)dumped_until, byte_arr, row_state, progress, std::cout);
+      dumped_until += row_state.length;
+    }
+    if (!needle.empty())
+    {
+      const uint64_t scan_from = old_size >= needle.size() ? old_size - needle.size() + 1 : 0;
+      const std::vector<uint32_t> new_hits = find_all_occurrences(byte_arr, needle, progress, scan_from);
+      for (auto pos : new_hits)
+      {
+        std::cout << "Found occurrence at position 0x" << int_to_hex(pos) << " (hit " << hits->size() << ").\n";
+        hits->push_back(pos);
+      }
+    }
+  }
+  state.hits = hits;
+  state.hits_needle = needle;
+  std::cout << "Stopped following, the input data is " << byte_arr.size() << " bytes long.\n";
+}
+
+enum class command_id : uint8_t
+{
+  none, help, little, big, offset, length, type, bits, bitorder, export_values, row, find, find_hex, findall, findall_hex,
+  findval, clamp, hit, hits, summary, hash, index, follow, jobs, cancel, plus, minus, append, endianness, state, dump
+};
+
+struct command_name
+{
+  std::string_view name;
+  command_id id;
+};
+
+constexpr command_name command_names[] = {
+  { "help", command_id::help }, { "?", command_id::help }, { "-?", command_id::help },
+  { "little", command_id::little }, { "big", command_id::big },
+  { "offset", command_id::offset }, { "length", command_id::length },
+  { "type", command_id::type }, { "bits", command_id::bits }, { "bitorder", command_id::bitorder },
+  { "export", command_id::export_values }, { "row", command_id::row },
+  { "find", command_id::find }, { "find#", command_id::find_hex },
+  { "findall", command_id::findall }, { "findall#", command_id::findall_hex },
+  { "findval", command_id::findval }, { "clamp", command_id::clamp }, { "hit", command_id::hit }, { "hits", command_id::hits },
+  { "summary", command_id::summary }, { "hash", command_id::hash }, { "index", command_id::index },
+  { "follow", command_id::follow }, { "jobs", command_id::jobs }, { "cancel", command_id::cancel },
+  { "+", command_id::plus }, { "-", command_id::minus }, { ">>", command_id::append },
+  { "endianness", command_id::endianness }, { "state", command_id::state },
+  { "dump", command_id::dump }, { "d", command_id::dump }
+};
+
+constexpr uint32_t command_table_bits = 7;
+constexpr uint32_t command_table_size = 1 << command_table_bits;
+
+constexpr uint32_t command_hash(std::string_view name, uint32_t seed)
+{
+  uint32_t hash = 2166136261u ^ seed;
+  for (char ch : name)
+  {
+    hash ^= (uint8_t)ch;
+    hash *= 16777619u;
+  }
+  return hash >> (32 - command_table_bits);
+}
+
+// Searches a seed for which command_hash puts every command in its own slot.
+constexpr uint32_t find_command_seed()
+{
+  for (uint32_t seed = 0; seed < 100000; ++seed)
+  {
+    bool used[command_table_size] = {};
+    bool collision = false;
+    for (const auto& command : command_names)
+    {
+      const uint32_t slot = command_hash(command.name, seed);
+      collision = collision || used[slot];
+      used[slot] = true;
+    }
+    if (!collision)
+      return seed;
+  }
+  return 0xffffffff;
+}
+
+constexpr uint32_t command_seed = find_command_seed();
+static_assert(command_seed != 0xffffffff, "No perfect hash for the command names.");
+
+// Slot i holds 1 + the position in command_names of the command hashing to i,
+// or 0 if no command does.
+constexpr std::array<uint8_t, command_table_size> make_command_slots()
+{
+  std::array<uint8_t, command_table_size> slots = {};
+  for (size_t i = 0; i < sizeof(command_names) / sizeof(command_names[0]); ++i)
+    slots[command_hash(command_names[i].name, command_seed)] = (uint8_t)(i + 1);
+  return slots;
+}
+
+constexpr std::array<uint8_t, command_table_size> command_slots = make_command_slots();
+
+inline command_id lookup_command(std::string_view name)
+{
+  const uint8_t slot = command_slots[command_hash(name, command_seed)];
+  if (slot == 0 || command_names[slot - 1].name != name)
+    return command_id::none;
+  return command_names[slot - 1].id;
+}
+
+// Executes the commands read from in, one per line, until the input ends or
+// a quit command is read. All output goes to the output stream of jobs.
+void run_commands(std::vector<uint8_t>& byte_arr, const std::string& input, hex_state& state, job_list& jobs, std::istream& in, bool prompt)
+{
+  std::ostream& out = *jobs.out;
+  std::string command;
+  std::vector<std::string_view> arguments;
+  while (command != "exit" && command != "quit" && command != "q")
+  {
+    collect_finished_jobs(jobs, state);
+    if (prompt)
+      out << "> ";
+    if (!std::getline(in, command))
+      break;
+    collect_finished_jobs(jobs, state);
+    tokenize(command, arguments);
+    bool background = false;
+    if (!arguments.empty() && arguments.back() == "&")
+    {
+      background = !jobs.run_inline;
+      arguments.pop_back();
+    }
+    size_t argc = arguments.size();
+    std::string outputfile;
+    bool dump = false;
+    for (size_t i = 0; i < argc; ++i)
+    {
+      const bool has_argument = i + 1 < argc;
+      switch (lookup_command(arguments[i]))
+      {
+      case command_id::help:
+        print_help(out);
+        break;
+      case command_id::little:
+        state.little_endiann = true;
+        break;
+      case command_id::big:
+        state.little_endiann = false;
+        break;
+      case command_id::offset:
+        if (has_argument)
+        {
+          state.offset = interpret_number(arguments[++i]);
+          out << "Setting offset to " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
+        }
+        else
+          out << "The offset equals " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
+        break;
+      case command_id::length:
+        if (has_argument)
+        {
+          state.length = interpret_number(arguments[++i]);
+          out << "Setting length to " << state.length << "(0x" << int_to_hex(state.length) << ").\n";
+        }
+        else
+          out << "The length equals " << state.length << "(0x" << int_to_hex(state.length) << ").\n";
+        break;
+      case command_id::type:
+        if (has_argument)
+        {
+          ++i;
+          if (interpret_type(std::string(arguments[i]), state))
+            out << "Interpreting the bytes as " << dump_type_to_str(state) << ".\n";
+          else
+            out << "Unknown type " << arguments[i] << ", see help for the available types.\n";
+        }
+        else
+          out << "The type equals " << dump_type_to_str(state) << ".\n";
+        break;
+      case command_id::bits:
+        if (has_argument)
+        {
+          const uint32_t width = interpret_number(arguments[++i]);
+          if (width < 1 || width > max_bit_width)
+            out << "The bit width should be between 1 and " << max_bit_width << ".\n";
+          else
+          {
+            state.bit_width = width;
+            if (!is_bit_type(state.dump_type))
+              state.dump_type = dumptype::dumptype_ubits;
+            out << "Interpreting the bytes as " << dump_type_to_str(state) << ".\n";
+          }
+        }
+        else
+          out << "Packed values are " << state.bit_width << " bits wide, " << (state.msb_first ? "msb" : "lsb") << " first.\n";
+        break;
+      case command_id::bitorder:
+        if (has_argument)
+        {
+          state.msb_first = arguments[++i] != "lsb";
+          out << "Packed values are read " << (state.msb_first ? "msb" : "lsb") << " first.\n";
+        }
+        break;
+      case command_id::export_values:
+        if (has_argument)
+        {
+          const std::string filename(arguments[++i]);
+          std::unique_ptr<hex_job> job = make_job("export " + filename, state);
+          job->file.open(filename);
+          if (!job->file.is_open())
+            out << "Error: could not open " << filename << ".\n";
+          else
+          {
+            job->progress.total = dump_size(state.offset, byte_arr, state);
+            const uint8_t* first = byte_arr.data() + job->offset;
+            const uint8_t* last = first + job->progress.total;
+            run_job(jobs, std::move(job), state, background, [first, last, state](hex_job& j) {
+              export_data(first, last, state, j.progress, j.file);
+              });
+          }
+        }
+        break;
+      case command_id::row:
+        if (has_argument)
+          state.data_per_line = interpret_number(arguments[++i]);
+        out << state.data_per_line << " interpreted values will be printed per row.\n";
+        break;
+      case command_id::find:
+      case command_id::find_hex:
+        if (has_argument)
+        {
+          const std::string name(arguments[i]);
+          const std::string needle(arguments[++i]);
+          std::vector<uint8_t> find_arr = make_find_array(needle, name == "find#", out);
+          if (!find_arr.empty())
+          {
+            state.find_needle = find_arr;
+            std::unique_ptr<hex_job> job = make_job(name + " " + needle, state);
+            job->progress.total = byte_arr.size();
+            auto index = state.index;
+            run_job(jobs, std::move(job), state, background, [&byte_arr, find_arr, index](hex_job& j) {
+              std::vector<uint32_t> hits;
+              if (index && index_find_all(*index, byte_arr, find_arr, hits))
+                select_next_hit(j.offset, hits, *j.str);
+              else
+                find_next_occurence(j.offset, byte_arr, find_arr, j.progress, *j.str);
+              });
+          }
+        }
+        break;
+      case command_id::findall:
+      case command_id::findall_hex:
+        if (has_argument)
+        {
+          const std::string name(arguments[i]);
+          const std::string needle(arguments[++i]);
+          std::vector<uint8_t> find_arr = make_find_array(needle, name == "findall#", out);
+          if (!find_arr.empty())
+          {
+            state.find_needle = find_arr;
+            std::unique_ptr<hex_job> job = make_job(name + " " + needle, state);
+            job->progress.total = byte_arr.size();
+            job->needle = find_arr;
+            auto index = state.index;
+            run_job(jobs, std::move(job), state, background, [&byte_arr, find_arr, index](hex_job& j) {
+              auto hits = std::make_shared<std::vector<uint32_t>>();
+              if (!index || !index_find_all(*index, byte_arr, find_arr, *hits))
+                *hits = find_all_occurrences(byte_arr, find_arr, j.progress);
+              print_hits(*hits, *j.str);
+              j.hits = hits;
+              });
+          }
+        }
+        break;
+      case command_id::findval:
+        if (has_argument)
+        {
+          std::string value_str(arguments[++i]);
+          std::string tolerance_str;
+          bool both_orders = false;
+          while (i + 1 < argc)
+          {
+            const std::string_view option = arguments[i+1];
+            if (option == "both")
+              both_orders = true;
+            else if (tolerance_str.empty() && !option.empty() && (std::isdigit((unsigned char)option[0]) || option[0] == '.'))
+              tolerance_str = option;
+            else
+              break;
+            ++i;
+          }
+          std::string description = "findval " + value_str + (tolerance_str.empty() ? "" : " " + tolerance_str) + (both_orders ? " both" : "");
+          std::unique_ptr<hex_job> job = make_job(description, state);
+          job->progress.total = byte_arr.size();
+          run_job(jobs, std::move(job), state, background, [&byte_arr, value_str, tolerance_str, both_orders, state](hex_job& j) {
+            auto hits = std::make_shared<std::vector<uint32_t>>();
+            find_value(byte_arr, value_str, tolerance_str, both_orders, state, j.progress, *j.str, *hits);
+            if (!j.progress.cancelled)
+              j.hits = hits;
+            });
+        }
+        break;
+      case command_id::clamp:
+        if (i + 3 < argc)
+        {
+          std::string minimum_str(arguments[i+1]);
+          std::string maximum_str(arguments[i+2]);
+          std::string length_str(arguments[i+3]);
+          std::unique_ptr<hex_job> job = make_job("clamp " + minimum_str + " " + maximum_str + " " + length_str, state);
+          job->progress.total = state.offset < byte_arr.size() ? byte_arr.size() - state.offset : 0;
+          run_job(jobs, std::move(job), state, background, [&byte_arr, minimum_str, maximum_str, length_str, state](hex_job& j) {
+            find_clamp(j.offset, byte_arr, minimum_str, maximum_str, length_str, state, j.progress, *j.str);
+            });
+          i += 3;
+        }
+        break;
+      case command_id::hit:
+        if (has_argument)
+        {
+          uint32_t index = interpret_number(arguments[++i]);
+          if (!state.hits || index >= state.hits->size())
+            out << "There is no hit " << index << ".\n";
+          else
+          {
+            state.offset = (*state.hits)[index];
+            out << "Setting offset to " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
+          }
+        }
+        break;
+      case command_id::hits:
+        if (state.hits)
+          print_hits(*state.hits, out);
+        else
+          out << "There are no hits.\n";
+        break;
+      case command_id::summary:
+      case command_id::hash:
+      {
+        const bool summary = arguments[i] == "summary";
+        std::unique_ptr<hex_job> job = make_job(std::string(arguments[i]), state);
+        job->progress.total = dump_size(state.offset, byte_arr, state);
+        const uint8_t* first = byte_arr.data() + job->offset;
+        const uint8_t* last = first + job->progress.total;
+        run_job(jobs, std::move(job), state, background, [first, last, state, summary](hex_job& j) {
+          if (summary)
+            summary_data(first, last, state, j.progress, *j.str, false);
+          else
+            *j.str << "FNV-1a hash: " << hash_to_hex(hash_range(first, last, j.progress)) << "\n";
+          });
+        break;
+      }
+      case command_id::index:
+        if (has_argument && arguments[i+1] == "build")
+        {
+          ++i;
+          uint32_t step = 1;
+          if (i + 1 < argc && std::isdigit((unsigned char)arguments[i+1][0]))
+            step = interpret_number(arguments[++i]);
+          std::unique_ptr<hex_job> job = make_job("index build", state);
+          job->progress.total = 3 * (uint64_t)byte_arr.size();
+          const std::string filename = is_file(input) ? search_index_filename(input) : std::string();
+          run_job(jobs, std::move(job), state, background, [&byte_arr, step, filename](hex_job& j) {
+            j.index = build_search_index(byte_arr, step, j.progress, *j.str);
+            if (!j.index || filename.empty())
+              return;
+            if (write_search_index(*j.index, filename))
+              *j.str << "Wrote the search index to " << filename << ".\n";
+            else
+              *j.str << "Error: could not write the search index to " << filename << ".\n";
+            });
+        }
+        else
+          print_index_state(state.index, out);
+        break;
+      case command_id::follow:
+        if (jobs.run_inline)
+          out << "Following a file is not possible in batch mode.\n";
+        else if (!jobs.jobs.empty())
+          out << "Cancel or wait for the background jobs before following the file.\n";
+        else
+          follow_file(input, byte_arr, state);
+        break;
+      case command_id::jobs:
+        print_jobs(jobs);
+        break;
+      case command_id::cancel:
+        cancel_jobs(jobs, has_argument ? interpret_number(arguments[++i]) : 0);
+        break;
+      case command_id::plus:
+        state.offset += has_argument ? interpret_number(arguments[++i]) : 0;
+        out << "Setting offset to " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
+        break;
+      case command_id::minus:
+      {
+        uint32_t subtract = has_argument ? interpret_number(arguments[++i]) : 0;
+        state.offset = subtract > state.offset ? 0 : state.offset-subtract;
+        out << "Setting offset to " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
+        break;
+      }
+      case command_id::append:
+        if (has_argument)
+          outputfile = arguments[++i];
+        break;
+      case command_id::endianness:
+        if (is_little_endian())
+          out << "I detected little-endian" << std::endl;
+        else
+          out << "I detected big-endian" << std::endl;
+        break;
+      case command_id::state:
+        if (state.little_endiann)
+          out << "I interpret data as little-endian.\n";
+        else
+          out << "I interpret data as big-endian.\n";
+        out << "A dump will start at offset " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
+        if (state.length == 0xffffffff)
+          out << "A dump will print untill the end of the given data.\n";
+        else
+          out << "A dump will print " << state.length << "(0x" << int_to_hex(state.length) << ") bytes.\n";
+        out << "Interpreting the bytes as " << dump_type_to_str(state) << ".\n";
+        out << state.data_per_line << " interpreted values will be printed per row.\n";
+        out << "The input data is " << byte_arr.size() << " bytes long.\n";
+        break;
+      case command_id::dump:
+        dump = true;
+        break;
+      case command_id::none:
+        if (arguments[i].find("+") == 0)
+        {
+          state.offset += interpret_number(arguments[i].substr(1));
+          out << "Setting offset to " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
+        }
+        else if (arguments[i].find("-") == 0)
+        {
+          uint32_t subtract = interpret_number(arguments[i].substr(1));
+          state.offset = subtract > state.offset ? 0 : state.offset-subtract;
+          out << "Setting offset to " << state.offset << "(0x" << int_to_hex(state.offset) << ").\n";
+        }
+        else if (arguments[i].find(">>") == 0)
+          outputfile = arguments[i].substr(2);
+        break;
+      }
+    }
+    if (dump && outputfile.empty()) {
+      if (background)
+        out << "A background dump needs an output file (>> <file>), dumping in the foreground.\n";
+      // a dump to the console needs no job, it runs directly on the state
+      interrupt_listener listener;
+      job_progress progress;
+      progress.total = dump_size(state.offset, byte_arr, state);
+      dump_data(state.offset, byte_arr, state, progress, out);
+    }
+    else if (dump) {
+      std::unique_ptr<hex_job> job = make_job("dump", state);
+      job->file.open(outputfile);
+      if (job->file.is_open())
+        job->str = &job->file;
+      job->progress.total = dump_size(job->offset, byte_arr, state);
+      const bool dump_in_background = background && job->str == &job->file;
+      run_job(jobs, std::move(job), state, dump_in_background, [&byte_arr, state](hex_job& j) {
+        dump_data(j.offset, byte_arr, state, j.progress, *j.str);
+        });
+    }
+  }
+}
+
+void hex_interpret(std::vector<uint8_t>& byte_arr, const std::string& input)
+{
+  hex_state state;
+  job_list jobs;
+  if (is_file(input))
+    state.index = load_search_index(search_index_filename(input), byte_arr, std::cout);
+  std::signal(SIGINT, on_interrupt);
+  run_commands(byte_arr, input, state, jobs, std::cin, true);
+}
+
+// Fixed size pool of worker threads executing queued tasks in fifo order.
+class thread_pool
+{
+public:
+  thread_pool(uint32_t nr_of_threads)
+  {
+    if (nr_of_threads == 0)
+      nr_of_threads = 1;
+    for (uint32_t i = 0; i < nr_of_threads; ++i)
+      _workers.emplace_back([this]() { work(); });
+  }
+
+  ~thread_pool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _condition.notify_all();
+    for (auto& worker : _workers)
+      worker.join();
+  }
+
+  void push(std::function<void()> task)
+  {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _tasks.push_back(std::move(task));
+    }
+    _condition.notify_one();
+  }
+
+private:
+  void work()
+  {
+    while (true)
+    {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _condition.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+        if (_tasks.empty())
+          return;
+        task = std::move(_tasks.front());
+        _tasks.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> _workers;
+  std::deque<std::function<void()>> _tasks;
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  bool _stop = false;
+};
+
+// Members of a flat json object (no nesting), numbers and booleans are kept
+// as their textual representation.
+typedef std::map<std::string, std::string> json_object;
+
+bool parse_json_string(const std::string& s, size_t& pos, std::string& value)
+{
+  if (pos >= s.size() || s[pos] != '"')
+    return false;
+  ++pos;
+  while (pos < s.size() && s[pos] != '"')
+  {
+    char c = s[pos++];
+    if (c == '\\' && pos < s.size())
+    {
+      c = s[pos++];
+      if (c == 'n')
+        c = '\n';
+      else if (c == 't')
+        c = '\t';
+      else if (c == 'r')
+        c = '\r';
+      else if (c == 'u' && pos + 4 <= s.size())
+      {
+        c = (char)(char_to_int(s[pos + 2]) * 16 + char_to_int(s[pos + 3]));
+        pos += 4;
+      }
+    }
+    value.push_back(c);
+  }
+  if (pos >= s.size())
+    return false;
+  ++pos;
+  return true;
+}
+
+bool parse_json_object(const std::string& s, json_object& obj)
+{
+  size_t pos = s.find_first_not_of(" \t\r\n");
+  if (pos == std::string::npos || s[pos] != '{')
+    return false;
+  ++pos;
+  while (true)
+  {
+    pos = s.find_first_not_of(" \t\r\n,", pos);
+    if (pos == std::string::npos)
+      return false;
+    if (s[pos] == '}')
+      return true;
+    std::string key, value;
+    if (!parse_json_string(s, pos, key))
+      return false;
+    pos = s.find_first_not_of(" \t\r\n", pos);
+    if (pos == std::string::npos || s[pos] != ':')
+      return false;
+    pos = s.find_first_not_of(" \t\r\n", pos + 1);
+    if (pos == std::string::npos)
+      return false;
+    if (s[pos] == '"')
+    {
+      if (!parse_json_string(s, pos, value))
+        return false;
+    }
+    else
+    {
+      size_t end = s.find_first_of(",} \t\r\n", pos);
+      if (end == std::string::npos)
+        return false;
+      value = s.substr(pos, end - pos);
+      pos = end;
+    }
+    obj[key] = value;
+  }
+}
+
+std::string json_escape(const std::string& s)
+{
+  std::string escaped;
+  for (char c : s)
+  {
+    if (c == '"' || c == '\\')
+    {
+      escaped.push_back('\\');
+      escaped.push_back(c);
+    }
+    else if ((unsigned char)c < 32)
+      escaped += "\\u00" + int_to_hex(c);
+    else
+      escaped.push_back(c);
+  }
+  return escaped;
+}
+
+// Shared, read-only input of the query server. Search results are cached per
+// needle so that repeated find and findall queries don't rescan the data.
+// The hit cache keeps at most max_cached_needles hit lists holding together
+// at most max_cached_hits positions, the oldest lists are dropped first.
+const size_t max_cached_needles = 256;
+const uint64_t max_cached_hits = 1 << 24;
+
+// Dumps answer at most max_dump_length bytes.
+const uint64_t max_dump_length = 1 << 16;
+
+struct query_server
+{
+  const std::vector<uint8_t>& byte_arr;
+  std::map<std::vector<uint8_t>, std::shared_ptr<const std::vector<uint32_t>>> hit_cache;
+  std::deque<std::vector<uint8_t>> hit_cache_order;
+  uint64_t nr_of_cached_hits = 0;
+  std::mutex hit_cache_mutex;
+  std::shared_ptr<const search_index> index;
+
+  query_server(const std::vector<uint8_t>& arr) : byte_arr(arr) {}
+};
+
+std::shared_ptr<const std::vector<uint32_t>> cached_hits(query_server& server, const std::vector<uint8_t>& find_arr)
+{
+  {
+    std::lock_guard<std::mutex> lock(server.hit_cache_mutex);
+    auto it = server.hit_cache.find(find_arr);
+    if (it != server.hit_cache.end())
+      return it->second;
+  }
+  job_progress progress;
+  progress.interrupt_generation = interrupt_count;
+  auto hits = std::make_shared<std::vector<uint32_t>>();
+  if (!server.index || !index_find_all(*server.index, server.byte_arr, find_arr, *hits))
+    *hits = find_all_occurrences(server.byte_arr, find_arr, progress);
+  if (progress.cancelled || hits->size() > max_cached_hits)
+    return hits;
+  std::lock_guard<std::mutex> lock(server.hit_cache_mutex);
+  auto inserted = server.hit_cache.emplace(find_arr, hits);
+  if (!inserted.second)
+    return inserted.first->second;
+  server.hit_cache_order.push_back(find_arr);
+  server.nr_of_cached_hits += hits->size();
+  while (server.hit_cache.size() > max_cached_needles || server.nr_of_cached_hits > max_cached_hits)
+  {
+    auto oldest = server.hit_cache.find(server.hit_cache_order.front());
+    server.nr_of_cached_hits -= oldest->second->size();
+    server.hit_cache.erase(oldest);
+    server.hit_cache_order.pop_front();
+  }
+  return hits;
+}
+
+// Answers one request line of the form
+//   {"op":"dump|find|findall|summary|hash|info", "offset":..., "length":...,
+//    "type":"f|u12|...", "endian":"little|big", "bitorder":"msb|lsb",
+//    "pattern":"text"|"hex":"0A 0B", "limit":...}
+// with a single line json response. A dump answers at most max_dump_length
+// bytes, also when no length is given.
+std::string answer_query(query_server& server, const std::string& request)
+{
+  json_object obj;
+  if (!parse_json_object(request, obj))
+    return "{\"ok\":false,\"error\":\"invalid request\"}";
+  const std::vector<uint8_t>& byte_arr = server.byte_arr;
+  const std::string op = obj["op"];
+  const uint32_t offset = obj.count("offset") ? interpret_number(obj["offset"]) : 0;
+  const uint64_t available = offset < byte_arr.size() ? byte_arr.size() - offset : 0;
+  uint64_t length = obj.count("length") ? interpret_number(obj["length"]) : available;
+  if (length > available)
+    length = available;
+  const uint8_t* first = byte_arr.data() + (offset < byte_arr.size() ? offset : byte_arr.size());
+  const uint8_t* last = first + length;
+  hex_state query_state;
+  if (obj.count("type") && !interpret_type(obj["type"], query_state))
+    return "{\"ok\":false,\"error\":\"invalid type\"}";
+  if (obj.count("endian"))
+    query_state.little_endiann = obj["endian"] != "big";
+  if (obj.count("bitorder"))
+    query_state.msb_first = obj["bitorder"] != "lsb";
+  job_progress progress;
+  progress.interrupt_generation = interrupt_count;
+  std::stringstream str;
+  str << "{\"ok\":true,\"op\":\"" << json_escape(op) << "\"";
+  if (op == "info")
+  {
+    str << ",\"size\":" << byte_arr.size();
+  }
+  else if (op == "dump")
+  {
+    if (length > max_dump_length)
+      last = first + max_dump_length;
+    str << ",\"offset\":" << offset << ",\"length\":" << (last - first) << ",\"hex\":\"";
+    for (const uint8_t* p = first; p != last; ++p)
+      str << int_to_hex(*p);
+    str << "\",\"values\":";
+    kernels_of(query_state).json_values(first, last, query_state, str);
+  }
+  else if (op == "summary")
+  {
+    str << ",";
+    summary_data(first, last, query_state, progress, str, true);
+  }
+  else if (op == "hash")
+  {
+    str << ",\"fnv1a\":\"" << hash_to_hex(hash_range(first, last, progress)) << "\"";
+  }
+  else if (op == "find" || op == "findall")
+  {
+    std::vector<uint8_t> find_arr;
+    if (obj.count("hex"))
+    {
+      std::stringstream errors;
+      find_arr = hex_to_byte_array(obj["hex"], errors);
+      if (!errors.str().empty())
+        return "{\"ok\":false,\"error\":\"invalid hex\"}";
+    }
+    else
+      find_arr.assign(obj["pattern"].begin(), obj["pattern"].end());
+    if (find_arr.empty())
+      return "{\"ok\":false,\"error\":\"nothing to find\"}";
+    auto hits = cached_hits(server, find_arr);
+    if (op == "find")
+    {
+      // next occurrence after offset, wrapping around like the find command
+      auto it = std::upper_bound(hits->begin(), hits->end(), offset);
+      if (it == hits->end())
+        it = hits->begin();
+      str << ",\"position\":";
+      if (it == hits->end())
+        str << "null";
+      else
+        str << *it;
+    }
+    else
+    {
+      const size_t limit = obj.count("limit") ? interpret_number(obj["limit"]) : hits->size();
+      str << ",\"count\":" << hits->size() << ",\"positions\":[";
+      for (size_t i = 0; i < hits->size() && i < limit; ++i)
+        str << (i ? "," : "") << (*hits)[i];
+      str << "]";
+    }
+  }
+  else
+    return "{\"ok\":false,\"error\":\"unknown op\"}";
+  str << "}";
+  return str.str();
+}
+
+#ifdef _WIN32
+int serve(const std::vector<uint8_t>&, const std::string&, const std::string&)
+{
+  std::cout << "Error: --serve needs unix domain sockets and is not available on this platform.\n";
+  return 1;
+}
+#else
+// Requests longer than max_request_size close the connection.
+const size_t max_request_size = 1 << 20;
+
+// A client connection. The poll loop of serve reads the requests, the pool
+// answers them one at a time per connection, so that the responses keep the
+// order of the requests. The socket is closed once the client is done and no
+// request is being answered.
+struct query_connection
+{
+  int fd;
+  std::string pending;
+  std::mutex mutex;
+  std::deque<std::string> requests;
+  bool busy = false;
+  bool reading = true;
+
+  query_connection(int f) : fd(f) {}
+};
+
+bool send_all(int fd, const std::string& response)
+{
+  size_t sent = 0;
+  while (sent < response.size())
+  {
+    ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    sent += (size_t)n;
+  }
+  return true;
+}
+
+// Answers the queued requests of connection on a pool thread.
+void answer_requests(query_server& server, std::shared_ptr<query_connection> connection)
+{
+  std::unique_lock<std::mutex> lock(connection->mutex);
+  while (!connection->requests.empty())
+  {
+    std::string request = std::move(connection->requests.front());
+    connection->requests.pop_front();
+    lock.unlock();
+    std::string response = answer_query(server, request);
+    response.push_back('\n');
+    const bool sent = send_all(connection->fd, response);
+    lock.lock();
+    if (!sent)
+    {
+      connection->requests.clear();
+      shutdown(connection->fd, SHUT_RDWR);
+    }
+  }
+  connection->busy = false;
+  if (!connection->reading)
+    close(connection->fd);
+}
+
+// Reads from connection and queues its complete request lines. Returns false
+// when the client is done.
+bool read_requests(query_server& server, thread_pool& pool, std::shared_ptr<query_connection> connection)
+{
+  char buffer[4096];
+  ssize_t received = recv(connection->fd, buffer, sizeof(buffer), 0);
+  if (received <= 0)
+    return false;
+  connection->pending.append(buffer, (size_t)received);
+  std::lock_guard<std::mutex> lock(connection->mutex);
+  size_t newline;
+  while ((newline = connection->pending.find('\n')) != std::string::npos)
+  {
+    connection->requests.push_back(connection->pending.substr(0, newline));
+    connection->pending.erase(0, newline + 1);
+  }
+  if (!connection->requests.empty() && !connection->busy)
+  {
+    connection->busy = true;
+    pool.push([&server, connection]() { answer_requests(server, connection); });
+  }
+  return connection->pending.size() <= max_request_size;
+}
+
+void close_connection(std::shared_ptr<query_connection> connection)
+{
+  std::lock_guard<std::mutex> lock(connection->mutex);
+  connection->reading = false;
+  if (connection->busy)
+    shutdown(connection->fd, SHUT_RD);
+  else
+    close(connection->fd);
+}
+
+// Serves queries on a unix domain socket until Ctrl-C is pressed. A single
+// poll loop accepts the connections and reads their newline separated
+// requests, the thread pool answers them. Idle connections therefore never
+// occupy a pool thread.
+int serve(const std::vector<uint8_t>& byte_arr, const std::string& socket_path, const std::string& input)
+{
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path))
+  {
+    std::cout << "Error: socket path " << socket_path << " is too long.\n";
+    return 1;
+  }
+  strcpy(address.sun_path, socket_path.c_str());
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_path.c_str());
+  if (listen_fd < 0 || bind(listen_fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listen_fd, 64) != 0)
+  {
+    std::cout << "Error: could not listen on " << socket_path << ".\n";
+    return 1;
+  }
+  // no SA_RESTART, so that Ctrl-C interrupts the blocking poll
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_interrupt;
+  sigaction(SIGINT, &action, nullptr);
+  interrupt_listener listener;
+  const uint32_t generation = interrupt_count;
+  query_server server(byte_arr);
+  if (is_file(input))
+    server.index = load_search_index(search_index_filename(input), byte_arr, std::cout);
+  std::map<int, std::shared_ptr<query_connection>> connections;
+  {
+    thread_pool pool(std::thread::hardware_concurrency());
+    std::cout << "Serving " << byte_arr.size() << " bytes on " << socket_path << ", press Ctrl-C to stop.\n";
+    std::vector<pollfd> fds;
+    while (generation == interrupt_count)
+    {
+      fds.clear();
+      fds.push_back({ listen_fd, POLLIN, 0 });
+      for (const auto& connection : connections)
+        fds.push_back({ connection.first, POLLIN, 0 });
+      if (poll(fds.data(), fds.size(), 250) <= 0)
+        continue;
+      for (size_t i = 1; i < fds.size(); ++i)
+      {
+        if (!fds[i].revents)
+          continue;
+        auto it = connections.find(fds[i].fd);
+        if (!read_requests(server, pool, it->second))
+        {
+          close_connection(it->second);
+          connections.erase(it);
+        }
+      }
+      if (fds[0].revents & POLLIN)
+      {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd >= 0)
+          connections[fd] = std::make_shared<query_connection>(fd);
+      }
+    }
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    for (auto& connection : connections)
+      close_connection(connection.second);
+    std::cout << "Stopped serving.\n";
+  }
+  return 0;
+}
+#endif
+
+
+// Expands the inputs of the batch mode into file names. An input @<file>
+// lists file names, one per line, an input with wildcards is expanded, and
+// any other input is taken as a file name.
+std::vector<std::string> expand_batch_inputs(const std::vector<std::string>& inputs)
+{
+  std::vector<std::string> filenames;
+  for (const auto& input : inputs)
+  {
+    if (input.size() > 1 && input[0] == '@')
+    {
+      std::ifstream f(input.substr(1));
+      if (!f.is_open())
+      {
+        std::cout << "Error: could not open the file list " << input.substr(1) << ".\n";
+        continue;
+      }
+      std::string line;
+      while (std::getline(f, line))
+      {
+        if (!line.empty() && line.back() == '\r')
+          line.pop_back();
+        if (!line.empty())
+          filenames.push_back(line);
+      }
+    }
+#ifndef _WIN32
+    else if (input.find_first_of("*?[") != std::string::npos)
+    {
+      glob_t matches;
+      if (glob(input.c_str(), 0, nullptr, &matches) == 0)
+      {
+        for (size_t i = 0; i < matches.gl_pathc; ++i)
+          filenames.push_back(matches.gl_pathv[i]);
+      }
+      else
+        std::cout << "No files match " << input << ".\n";
+      globfree(&matches);
+    }
+#endif
+    else
+      filenames.push_back(input);
+  }
+  return filenames;
+}
+
+struct batch_file
+{
+  std::string name;
+  uint64_t size = 0;
+  bool readable = false;
+  bool skipped = false;
+  uint64_t nr_of_hits = 0;
+  std::string output;
+};
+
+void run_batch_file(batch_file& file, const std::string& script, uint32_t interrupt_generation)
+{
+  std::stringstream out;
+  out << "==> " << file.name << " <==\n";
+  std::vector<uint8_t> byte_arr;
+  if (interrupt_generation != interrupt_count)
+  {
+    file.skipped = true;
+    out << "Skipped.\n";
+  }
+  else if (!read_file(file.name, byte_arr))
+    out << "Error: could not read " << file.name << ".\n";
+  else
+  {
+    file.readable = true;
+    hex_state state;
+    job_list jobs;
+    jobs.out = &out;
+    jobs.run_inline = true;
+    state.index = load_search_index(search_index_filename(file.name), byte_arr, out);
+    std::istringstream in(script);
+    run_commands(byte_arr, file.name, state, jobs, in, false);
+    if (state.hits)
+      file.nr_of_hits = state.hits->size();
+  }
+  file.output = out.str();
+}
+
+// Runs the commands of script_filename against every input file on a work
+// stealing pool. Files smaller than batch_bytes are grouped into tasks of
+// about batch_bytes, larger files get their own task and split their
+// searches into tasks of the same pool. The tasks are queued from small to
+// large, so that the workers start with the largest ones. The output of each
+// file is printed in the order of the inputs, followed by a summary.
+int run_batch(const std::string& script_filename, uint32_t nr_of_threads, const std::vector<std::string>& inputs)
+{
+  std::ifstream script_file(script_filename);
+  if (!script_file.is_open())
+  {
+    std::cout << "Error: could not open the script " << script_filename << ".\n";
+    return 1;
+  }
+  const std::string script((std::istreambuf_iterator<char>(script_file)), {});
+  const std::vector<std::string> filenames = expand_batch_inputs(inputs);
+  if (filenames.empty())
+  {
+    std::cout << "There are no files to process.\n";
+    return 1;
+  }
+  std::vector<batch_file> files(filenames.size());
+  for (size_t i = 0; i < files.size(); ++i)
+  {
+    files[i].name = filenames[i];
+    std::ifstream f(filenames[i], std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
+    if (f.is_open())
+      files[i].size = (uint64_t)f.tellg();
+  }
+
+  const uint64_t batch_bytes = 1 << 20;
+  const size_t max_files_per_batch = 64;
+  std::vector<std::pair<uint64_t, std::vector<size_t>>> tasks;
+  std::vector<size_t> batch;
+  uint64_t batch_size = 0;
+  for (size_t i = 0; i < files.size(); ++i)
+  {
+    if (files[i].size >= batch_bytes)
+    {
+      tasks.emplace_back(files[i].size, std::vector<size_t>(1, i));
+      continue;
+    }
+    batch.push_back(i);
+    batch_size += files[i].size;
+    if (batch_size >= batch_bytes || batch.size() == max_files_per_batch)
+    {
+      tasks.emplace_back(batch_size, batch);
+      batch.clear();
+      batch_size = 0;
+    }
+  }
+  if (!batch.empty())
+    tasks.emplace_back(batch_size, batch);
+  std::stable_sort(tasks.begin(), tasks.end(), [](const auto& left, const auto& right) { return left.first < right.first; });
+
+  std::signal(SIGINT, on_interrupt);
+  interrupt_listener listener;
+  const uint32_t interrupt_generation = interrupt_count;
+  const auto start = std::chrono::steady_clock::now();
+  std::mutex finished_mutex;
+  std::condition_variable finished_condition;
+  std::vector<bool> finished(files.size(), false);
+  {
+    work_stealing_pool pool(nr_of_threads);
+    for (const auto& task : tasks)
+    {
+      const std::vector<size_t>& indices = task.second;
+      pool.push([&, indices]() {
+        for (size_t i : indices)
+        {
+          run_batch_file(files[i], script, interrupt_generation);
+          {
+            std::lock_guard<std::mutex> lock(finished_mutex);
+            finished[i] = true;
+          }
+          finished_condition.notify_all();
+        }
+        });
+    }
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+      {
+        std::unique_lock<std::mutex> lock(finished_mutex);
+        finished_condition.wait(lock, [&]() { return finished[i]; });
+      }
+      std::cout << files[i].output << std::flush;
+      std::string().swap(files[i].output);
+    }
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  uint64_t nr_of_bytes = 0, nr_of_hits = 0;
+  size_t nr_of_processed = 0, nr_of_unreadable = 0, nr_of_skipped = 0, nr_of_files_with_hits = 0;
+  for (const auto& file : files)
+  {
+    if (file.skipped)
+      ++nr_of_skipped;
+    else if (!file.readable)
+      ++nr_of_unreadable;
+    else
+    {
+      ++nr_of_processed;
+      nr_of_bytes += file.size;
+      nr_of_hits += file.nr_of_hits;
+      if (file.nr_of_hits)
+        ++nr_of_files_with_hits;
+    }
+  }
+  std::cout << "==> summary <==\n";
+  std::cout << "Processed " << nr_of_processed << " of " << files.size() << " files, " << nr_of_bytes << " bytes, in " << seconds << "s";
+  if (seconds > 0.0)
+    std::cout << " (" << (uint64_t)(nr_of_bytes / seconds / (1024.0 * 1024.0)) << " MB/s)";
+  std::cout << " on " << std::max(1u, nr_of_threads) << " threads.\n";
+  if (nr_of_unreadable)
+    std::cout << nr_of_unreadable << " files could not be read.\n";
+  if (nr_of_skipped)
+    std::cout << nr_of_skipped << " files were skipped after an interrupt.\n";
+  std::cout << nr_of_hits << " hits in " << nr_of_files_with_hits << " files.\n";
+  return nr_of_unreadable ? 1 : 0;
+}
+
+
+// Discards everything written to it.
+class null_buffer : public std::streambuf
+{
+protected:
+  int overflow(int ch) override
+  {
+    return ch;
+  }
+
+  std::streamsize xsputn(const char*, std::streamsize count) override
+  {
+    return count;
+  }
+};
+
+// Measures the number of commands per second for a script of small offset
+// and dump commands, once only tokenizing and looking up the commands and
+// once executing them through the interactive command loop on 64 KB of data
+// with the output discarded.
+int run_command_benchmark(uint64_t nr_of_commands)
+{
+  std::vector<uint8_t> byte_arr(1 << 16);
+  uint32_t seed = 1;
+  for (auto& byte : byte_arr)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    byte = (uint8_t)(seed >> 24);
+  }
+  std::string script = "length 32\n";
+  script.reserve(nr_of_commands * 14);
+  char line[32];
+  for (uint64_t i = 0; i < nr_of_commands; ++i)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    if (i % 2 == 0)
+    {
+      snprintf(line, sizeof(line), "offset 0x%x\n", (seed >> 16) & 0xffff);
+      script += line;
+    }
+    else
+      script += "dump\n";
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::string_view> tokens;
+  std::string_view rest(script);
+  uint64_t checksum = 0;
+  while (!rest.empty())
+  {
+    const size_t end_of_line = std::min(rest.find('\n'), rest.size());
+    tokenize(rest.substr(0, end_of_line), tokens);
+    rest.remove_prefix(std::min(end_of_line + 1, rest.size()));
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+      const command_id id = lookup_command(tokens[i]);
+      checksum += (uint32_t)id;
+      if ((id == command_id::offset || id == command_id::length) && i + 1 < tokens.size())
+        checksum += interpret_number(tokens[++i]);
+    }
+  }
+  const double parse_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  null_buffer buffer;
+  std::ostream null_stream(&buffer);
+  hex_state state;
+  job_list jobs;
+  jobs.out = &null_stream;
+  std::istringstream in(script);
+  start = std::chrono::steady_clock::now();
+  run_commands(byte_arr, std::string(), state, jobs, in, false);
+  const double run_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << "Parsed " << nr_of_commands << " commands in " << parse_seconds << "s: " << (uint64_t)(nr_of_commands / parse_seconds) << " commands/s (checksum " << checksum << ").\n";
+  std::cout << "Executed " << nr_of_commands << " commands in " << run_seconds << "s: " << (uint64_t)(nr_of_commands / run_seconds) << " commands/s.\n";
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc > 3 && std::string(argv[1]) == "--serve")
+  {
+    std::string input = std::string(argv[3]);
+    std::vector<uint8_t> byte_arr = read_input(input);
+    return serve(byte_arr, std::string(argv[2]), input);
+  }
+  else if (argc > 3 && std::string(argv[1]) == "--batch")
+  {
+    uint32_t nr_of_threads = std::thread::hardware_concurrency();
+    int first_input = 3;
+    if (argc > 5 && std::string(argv[3]) == "-j")
+    {
+      nr_of_threads = interpret_number(std::string(argv[4]));
+      first_input = 5;
+    }
+    return run_batch(std::string(argv[2]), nr_of_threads, std::vector<std::string>(argv + first_input, argv + argc));
+  }
+  else if (argc > 1 && std::string(argv[1]) == "--bench-commands")
+  {
+    return run_command_benchmark(argc > 2 ? interpret_number<uint64_t>(argv[2]) : 2000000);
+  }
+  else if (argc > 1)
   {
     std::string input = std::string(argv[1]);
     std::vector<uint8_t> byte_arr = read_input(input);
-    hex_interpret(byte_arr);
+    hex_interpret(byte_arr, input);
   }
   else
   {
     std::cout << "Usage:    hex_interpret \"<hex text dump>\"|<binfile>" << std::endl;
     std::cout << "Example:  hex_interpret \"01 01 AA FF CA 3F 27 28\"" << std::endl;
     std::cout << "          hex_interpret d3d12.dll" << std::endl;
+    std::cout << "Serve:    hex_interpret --serve <unix socket> \"<hex text dump>\"|<binfile>" << std::endl;
+    std::cout << "          answers newline separated json requests such as" << std::endl;
+    std::cout << "          {\"op\":\"findall\",\"hex\":\"4D 5A\",\"limit\":10}" << std::endl;
+    std::cout << "          with op dump, find, findall, summary, hash or info" << std::endl;
+    std::cout << "Batch:    hex_interpret --batch <script> [-j <threads>] <file|glob|@filelist>..." << std::endl;
+    std::cout << "          runs the commands in script against every file" << std::endl;
+    std::cout << "Bench:    hex_interpret --bench-commands [<nr of commands>]" << std::endl;
+    std::cout << "          measures the commands per second of a script of offset and dump commands" << std::endl;
   }
   return 0;
 }